@@ -1,17 +1,191 @@
 #include "cli.hpp"
 
+#include "parse_arguments.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+
 #include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
 
 namespace cli {
 
 namespace {
 // Helper for C++17 compatibility (starts_with is C++20)
-bool starts_with(const std::string& str, const std::string& prefix) {
+bool starts_with(std::string_view str, std::string_view prefix) {
     return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
 }
+
+// Parse a number that fills all of text
+template <typename T>
+bool parse_number(std::string_view text, T& out) {
+    const char* end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(text.data(), end, out);
+    return ec == std::errc() && ptr == end;
+}
+
+// Split "<number><unit>" where the number is the leading digits and dots
+std::pair<std::string_view, std::string_view> split_unit(std::string_view text) {
+    size_t pos = text.find_first_not_of("0123456789.");
+    if (pos == std::string_view::npos) {
+        return {text, {}};
+    }
+    return {text.substr(0, pos), text.substr(pos)};
+}
+
+bool parse_size(std::string_view text, std::uint64_t& out) {
+    auto [number, unit] = split_unit(text);
+    std::uint64_t value = 0;
+    if (!parse_number(number, value)) {
+        return false;
+    }
+    int shift = 0;
+    if (!unit.empty()) {
+        switch (unit[0]) {
+            case 'K': case 'k': shift = 10; break;
+            case 'M': case 'm': shift = 20; break;
+            case 'G': case 'g': shift = 30; break;
+            case 'T': case 't': shift = 40; break;
+            default: return false;
+        }
+        unit.remove_prefix(1);
+        if (unit != "" && unit != "B" && unit != "iB") {
+            return false;
+        }
+    }
+    if (shift > 0 && value > (std::numeric_limits<std::uint64_t>::max() >> shift)) {
+        return false;
+    }
+    out = value << shift;
+    return true;
+}
+
+bool parse_duration(std::string_view text, std::chrono::nanoseconds& out) {
+    auto [number, unit] = split_unit(text);
+    double value = 0;
+    if (!parse_number(number, value)) {
+        return false;
+    }
+    double scale = 0;
+    if (unit.empty() || unit == "s") {
+        scale = 1e9;
+    } else if (unit == "ns") {
+        scale = 1;
+    } else if (unit == "us") {
+        scale = 1e3;
+    } else if (unit == "ms") {
+        scale = 1e6;
+    } else if (unit == "m") {
+        scale = 60e9;
+    } else if (unit == "h") {
+        scale = 3600e9;
+    } else {
+        return false;
+    }
+    double ns = value * scale;
+    if (!(ns < static_cast<double>(std::numeric_limits<std::int64_t>::max()))) {
+        return false;
+    }
+    out = std::chrono::nanoseconds(static_cast<std::int64_t>(ns));
+    return true;
+}
+
+// Convert the text of a typed flag, including Enum choices
+bool convert_value(const FlagDef& def, std::string_view text, TypedValue& out) {
+    if (def.type != FlagType::Enum) {
+        return parse_flag_value(def.type, text, out);
+    }
+    for (size_t c = 0; c < def.choices.size(); ++c) {
+        if (def.choices[c] == text) {
+            out = Choice{c};
+            return true;
+        }
+    }
+    return false;
+}
+
+// What a flag's value looks like, e.g. "size" or "none|atomic|fsync"
+std::string value_name(const FlagDef& flag) {
+    if (flag.type != FlagType::Enum || flag.choices.empty()) {
+        return std::string(flag_type_name(flag.type));
+    }
+    std::string names;
+    for (const auto& choice : flag.choices) {
+        if (!names.empty()) names += '|';
+        names += choice;
+    }
+    return names;
+}
+
+// Help text for one flag line, e.g. "  -n, --lines <count>\tLines"
+std::string flag_help_line(const FlagDef& flag) {
+    std::string line = "  ";
+    if (!flag.short_name.empty()) {
+        line += flag.short_name;
+        if (!flag.long_name.empty()) {
+            line += ", ";
+        }
+    }
+    line += flag.long_name;
+    if (flag.type != FlagType::Boolean) {
+        line += " <" + value_name(flag) + ">";
+    }
+    if (!flag.description.empty()) {
+        line += "\t" + flag.description;
+    }
+    if (flag.required) {
+        line += " (required)";
+    }
+    return line + "\n";
+}
 } // namespace
 
+bool parse_flag_value(FlagType type, std::string_view text, TypedValue& out) {
+    switch (type) {
+        case FlagType::Int64: {
+            std::int64_t value = 0;
+            if (!parse_number(text, value)) return false;
+            out = value;
+            return true;
+        }
+        case FlagType::UInt64: {
+            std::uint64_t value = 0;
+            if (!parse_number(text, value)) return false;
+            out = value;
+            return true;
+        }
+        case FlagType::Double: {
+            double value = 0;
+            if (!parse_number(text, value) || !std::isfinite(value)) return false;
+            out = value;
+            return true;
+        }
+        case FlagType::Size: {
+            std::uint64_t value = 0;
+            if (!parse_size(text, value)) return false;
+            out = value;
+            return true;
+        }
+        case FlagType::Duration: {
+            std::chrono::nanoseconds value{};
+            if (!parse_duration(text, value)) return false;
+            out = value;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
 // ParseResult implementation
 bool ParseResult::get_bool(const std::string& flag_name) const {
     auto it = flags.find(flag_name);
@@ -35,11 +209,265 @@ bool ParseResult::has_flag(const std::string& flag_name) const {
     return flags.find(flag_name) != flags.end();
 }
 
+// FlagIndex implementation
+
+namespace {
+// 32-bit FNV-1a
+std::uint32_t hash_name(std::string_view name) {
+    std::uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Double an open-addressing table, reinserting by stored hash
+template <typename Slot>
+void grow_slots(std::vector<Slot>& slots) {
+    std::vector<Slot> old = std::move(slots);
+    slots.assign(old.empty() ? 16 : old.size() * 2, Slot{});
+    std::size_t mask = slots.size() - 1;
+    for (const auto& slot : old) {
+        if (slot.value == 0) continue;
+        std::size_t i = slot.hash & mask;
+        while (slots[i].value != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+}
+
+bool has_name(const FlagDef& flag, std::string_view name) {
+    return flag.short_name == name || flag.long_name == name;
+}
+} // namespace
+
+void FlagIndex::insert(const std::vector<FlagDef>& flags, std::uint32_t position) {
+    const FlagDef& flag = flags[position];
+    if (!flag.short_name.empty()) {
+        insert_name(flag.short_name, flags, position);
+    }
+    if (!flag.long_name.empty()) {
+        insert_name(flag.long_name, flags, position);
+    }
+}
+
+void FlagIndex::insert_name(std::string_view name, const std::vector<FlagDef>& flags,
+                            std::uint32_t position) {
+    if (find(name, flags)) {
+        return;
+    }
+    if ((used_ + 1) * 2 > slots_.size()) {
+        grow();
+    }
+    std::uint32_t hash = hash_name(name);
+    std::size_t mask = slots_.size() - 1;
+    std::size_t i = hash & mask;
+    while (slots_[i].value != 0) {
+        i = (i + 1) & mask;
+    }
+    slots_[i] = {hash, position + 1};
+    ++used_;
+}
+
+void FlagIndex::grow() {
+    grow_slots(slots_);
+}
+
+const FlagDef* FlagIndex::find(std::string_view name,
+                               const std::vector<FlagDef>& flags) const {
+    if (slots_.empty()) {
+        return nullptr;
+    }
+    std::uint32_t hash = hash_name(name);
+    std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = hash & mask; slots_[i].value != 0; i = (i + 1) & mask) {
+        const Slot& slot = slots_[i];
+        if (slot.hash == hash && has_name(flags[slot.value - 1], name)) {
+            return &flags[slot.value - 1];
+        }
+    }
+    return nullptr;
+}
+
+// CommandTrie implementation
+
+namespace {
+std::uint32_t child_hash(std::uint32_t parent, std::string_view name) {
+    return hash_name(name) ^ (parent * 0x9E3779B1u);
+}
+} // namespace
+
+CommandTrie::CommandTrie() : nodes_(1) {}
+
+std::string_view CommandTrie::name(std::uint32_t command) const {
+    const Node& node = nodes_[command];
+    return {names_.data() + node.name, node.name_size};
+}
+
+std::uint32_t CommandTrie::find(std::uint32_t parent, std::string_view name) const {
+    if (children_.empty()) {
+        return 0;
+    }
+    std::uint32_t hash = child_hash(parent, name);
+    std::size_t mask = children_.size() - 1;
+    for (std::size_t i = hash & mask; children_[i].value != 0; i = (i + 1) & mask) {
+        const Slot& slot = children_[i];
+        if (slot.hash == hash && nodes_[slot.value].parent == parent &&
+            this->name(slot.value) == name) {
+            return slot.value;
+        }
+    }
+    return 0;
+}
+
+std::uint32_t CommandTrie::intern(std::string_view name) {
+    std::uint32_t hash = hash_name(name);
+    if (!name_slots_.empty()) {
+        std::size_t mask = name_slots_.size() - 1;
+        for (std::size_t i = hash & mask; name_slots_[i].value != 0;
+             i = (i + 1) & mask) {
+            std::uint32_t offset = name_slots_[i].value - 1;
+            if (name_slots_[i].hash == hash &&
+                names_.compare(offset, name.size(), name) == 0 &&
+                names_[offset + name.size()] == '\0') {
+                return offset;
+            }
+        }
+    }
+    if ((name_count_ + 1) * 2 > name_slots_.size()) {
+        grow_slots(name_slots_);
+    }
+    auto offset = static_cast<std::uint32_t>(names_.size());
+    names_.append(name);
+    names_.push_back('\0');
+    std::size_t mask = name_slots_.size() - 1;
+    std::size_t i = hash & mask;
+    while (name_slots_[i].value != 0) {
+        i = (i + 1) & mask;
+    }
+    name_slots_[i] = {hash, offset + 1};
+    ++name_count_;
+    return offset;
+}
+
+std::uint32_t CommandTrie::insert(std::uint32_t parent, std::string_view name) {
+    if (std::uint32_t existing = find(parent, name)) {
+        return existing;
+    }
+    if (nodes_.size() * 2 > children_.size()) {
+        grow_slots(children_);
+    }
+    auto id = static_cast<std::uint32_t>(nodes_.size());
+    Node node;
+    node.parent = parent;
+    node.name = intern(name);
+    node.name_size = static_cast<std::uint32_t>(name.size());
+    node.next_sibling = nodes_[parent].first_child;
+    nodes_.push_back(node);
+    nodes_[parent].first_child = id;
+    
+    std::uint32_t hash = child_hash(parent, name);
+    std::size_t mask = children_.size() - 1;
+    std::size_t i = hash & mask;
+    while (children_[i].value != 0) {
+        i = (i + 1) & mask;
+    }
+    children_[i] = {hash, id};
+    return id;
+}
+
+std::vector<std::uint32_t> CommandTrie::children(std::uint32_t command) const {
+    std::vector<std::uint32_t> result;
+    for (std::uint32_t child = nodes_[command].first_child; child != 0;
+         child = nodes_[child].next_sibling) {
+        result.push_back(child);
+    }
+    std::sort(result.begin(), result.end(), [this](std::uint32_t a, std::uint32_t b) {
+        return name(a) < name(b);
+    });
+    return result;
+}
+
+// CommandBuilder implementation
+
+void CommandBuilder::set_callback(CommandCallback callback) {
+    executor_.commands_[command_].callback = std::move(callback);
+}
+
+void CommandBuilder::add_flag(const std::string& names, FlagType type,
+                              const std::string& description, bool required,
+                              const std::vector<std::string>& choices) {
+    CommandDef& command = executor_.commands_[command_];
+    CliExecutor::add_flag_to(command.flags, command.flag_index, names, type,
+                             description, required, choices);
+}
+
+void CommandBuilder::add_command(const std::string& path, const std::string& description,
+                                 CommandCallback callback) {
+    auto parts = CliExecutor::split_path(path, '.');
+    if (parts.empty()) return;
+    CommandDef& command = executor_.commands_[executor_.ensure_command(command_, parts)];
+    command.description = description;
+    command.callback = std::move(callback);
+}
+
+void CommandBuilder::add_lazy_command(const std::string& path,
+                                      const std::string& description,
+                                      CommandFactory factory) {
+    auto parts = CliExecutor::split_path(path, '.');
+    if (parts.empty()) return;
+    CommandDef& command = executor_.commands_[executor_.ensure_command(command_, parts)];
+    command.description = description;
+    command.factory = std::move(factory);
+}
+
+void CommandBuilder::add_command_flag(const std::string& path, const std::string& names,
+                                      FlagType type, const std::string& description,
+                                      bool required,
+                                      const std::vector<std::string>& choices) {
+    auto parts = CliExecutor::split_path(path, '.');
+    if (parts.empty()) return;
+    CommandDef& command = executor_.commands_[executor_.ensure_command(command_, parts)];
+    CliExecutor::add_flag_to(command.flags, command.flag_index, names, type,
+                             description, required, choices);
+}
+
+// ParseView implementation
+
+const ParseView::Flag* ParseView::find(std::string_view flag_name) const {
+    for (const auto& flag : flags) {
+        if (flag.name == flag_name) {
+            return &flag;
+        }
+    }
+    return nullptr;
+}
+
+bool ParseView::get_bool(std::string_view flag_name) const {
+    const Flag* flag = find(flag_name);
+    return flag && flag->type == FlagType::Boolean;
+}
+
+ArgSpan ParseView::get_args(std::string_view flag_name) const {
+    const Flag* flag = find(flag_name);
+    if (!flag || flag->type != FlagType::MultiArg || flag->count == 0) {
+        return {};
+    }
+    return {values.data() + flag->first, flag->count};
+}
+
+bool ParseView::has_flag(std::string_view flag_name) const {
+    return find(flag_name) != nullptr;
+}
+
 // CliExecutor implementation
 
 CliExecutor::CliExecutor(std::string program_name, std::string description)
     : program_name_(std::move(program_name))
-    , description_(std::move(description)) {
+    , description_(std::move(description))
+    , commands_(1) {  // Entry 0 stands for the trie root
     // Add built-in help flag
     add_flag("-h,--help", FlagType::Boolean, "Show help message");
 }
@@ -52,6 +480,10 @@ void CliExecutor::set_handler(CommandCallback callback) {
     default_handler_ = std::move(callback);
 }
 
+void CliExecutor::set_view_handler(ViewCallback callback) {
+    view_handler_ = std::move(callback);
+}
+
 std::pair<std::string, std::string> CliExecutor::parse_flag_names(const std::string& names) {
     std::string short_name, long_name;
     
@@ -86,15 +518,25 @@ std::pair<std::string, std::string> CliExecutor::parse_flag_names(const std::str
     return {short_name, long_name};
 }
 
-void CliExecutor::add_flag(const std::string& names, FlagType type,
-                           const std::string& description, bool required) {
+void CliExecutor::add_flag_to(std::vector<FlagDef>& flags, FlagIndex& index,
+                              const std::string& names, FlagType type,
+                              const std::string& description, bool required,
+                              const std::vector<std::string>& choices) {
     auto [short_name, long_name] = parse_flag_names(names);
-    global_flags_.push_back({short_name, long_name, type, description, required});
+    flags.push_back({short_name, long_name, type, description, required, choices});
+    index.insert(flags, static_cast<std::uint32_t>(flags.size() - 1));
+}
+
+void CliExecutor::add_flag(const std::string& names, FlagType type,
+                           const std::string& description, bool required,
+                           const std::vector<std::string>& choices) {
+    add_flag_to(global_flags_, global_index_, names, type, description, required,
+                choices);
 }
 
 void CliExecutor::add_command(const std::string& name, const std::string& description,
                               CommandCallback callback) {
-    commands_[name] = {name, description, std::move(callback), {}, {}};
+    add_nested_command(name, description, std::move(callback));
 }
 
 std::vector<std::string> CliExecutor::split_path(const std::string& path, char delimiter) {
@@ -109,291 +551,359 @@ std::vector<std::string> CliExecutor::split_path(const std::string& path, char d
     return parts;
 }
 
-CommandDef* CliExecutor::find_command(const std::vector<std::string>& path) {
-    if (path.empty()) return nullptr;
-    
-    auto it = commands_.find(path[0]);
-    if (it == commands_.end()) return nullptr;
-    
-    CommandDef* current = &it->second;
-    for (size_t i = 1; i < path.size(); ++i) {
-        auto sub_it = current->subcommands.find(path[i]);
-        if (sub_it == current->subcommands.end()) return nullptr;
-        current = &sub_it->second;
+std::uint32_t CliExecutor::find_command(const std::vector<std::string>& path) const {
+    // Expand lazy commands along the path, including the command found
+    std::uint32_t current = CommandTrie::kRoot;
+    for (const auto& part : path) {
+        current = trie_.find(current, part);
+        if (current == 0) return 0;
+        expand(current);
     }
     return current;
 }
 
-const CommandDef* CliExecutor::find_command(const std::vector<std::string>& path) const {
-    if (path.empty()) return nullptr;
-    
-    auto it = commands_.find(path[0]);
-    if (it == commands_.end()) return nullptr;
-    
-    const CommandDef* current = &it->second;
-    for (size_t i = 1; i < path.size(); ++i) {
-        auto sub_it = current->subcommands.find(path[i]);
-        if (sub_it == current->subcommands.end()) return nullptr;
-        current = &sub_it->second;
+std::uint32_t CliExecutor::ensure_command(std::uint32_t parent,
+                                          const std::vector<std::string>& parts) const {
+    std::uint32_t current = parent;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (i > 0) {
+            expand(current);
+        }
+        current = trie_.insert(current, parts[i]);
+        if (current >= commands_.size()) {
+            commands_.resize(current + 1);
+        }
     }
     return current;
 }
 
+void CliExecutor::expand(std::uint32_t command) const {
+    if (!commands_[command].factory) return;
+    // Move the factory out first: it runs once, and adding commands may
+    // reallocate commands_
+    CommandFactory factory = std::move(commands_[command].factory);
+    commands_[command].factory = nullptr;
+    CommandBuilder builder(*this, command);
+    factory(builder);
+}
+
 void CliExecutor::add_nested_command(const std::string& command_path,
                                      const std::string& description,
                                      CommandCallback callback) {
     auto parts = split_path(command_path, '.');
     if (parts.empty()) return;
     
-    // Ensure first level command exists
-    if (commands_.find(parts[0]) == commands_.end()) {
-        commands_[parts[0]] = {parts[0], "", nullptr, {}, {}};
-    }
-    
-    CommandDef* current = &commands_[parts[0]];
-    
-    // Navigate/create nested structure
-    for (size_t i = 1; i < parts.size(); ++i) {
-        if (current->subcommands.find(parts[i]) == current->subcommands.end()) {
-            current->subcommands[parts[i]] = {parts[i], "", nullptr, {}, {}};
-        }
-        current = &current->subcommands[parts[i]];
-    }
+    // Navigate/create nested structure and set the final command's properties
+    CommandDef& command = commands_[ensure_command(CommandTrie::kRoot, parts)];
+    command.description = description;
+    command.callback = std::move(callback);
+}
+
+void CliExecutor::add_lazy_command(const std::string& command_path,
+                                   const std::string& description,
+                                   CommandFactory factory) {
+    auto parts = split_path(command_path, '.');
+    if (parts.empty()) return;
     
-    // Set the final command's properties
-    current->description = description;
-    current->callback = std::move(callback);
+    CommandDef& command = commands_[ensure_command(CommandTrie::kRoot, parts)];
+    command.description = description;
+    command.factory = std::move(factory);
 }
 
 void CliExecutor::add_command_flag(const std::string& command_name, const std::string& names,
                                    FlagType type, const std::string& description,
-                                   bool required) {
-    auto it = commands_.find(command_name);
-    if (it != commands_.end()) {
-        auto [short_name, long_name] = parse_flag_names(names);
-        it->second.flags.push_back({short_name, long_name, type, description, required});
-    }
+                                   bool required, const std::vector<std::string>& choices) {
+    add_nested_command_flag(command_name, names, type, description, required, choices);
 }
 
 void CliExecutor::add_nested_command_flag(const std::string& command_path,
                                           const std::string& names, FlagType type,
                                           const std::string& description,
-                                          bool required) {
+                                          bool required,
+                                          const std::vector<std::string>& choices) {
     auto parts = split_path(command_path, '.');
-    CommandDef* cmd = find_command(parts);
-    if (cmd) {
-        auto [short_name, long_name] = parse_flag_names(names);
-        cmd->flags.push_back({short_name, long_name, type, description, required});
+    if (std::uint32_t id = find_command(parts)) {
+        CommandDef& command = commands_[id];
+        add_flag_to(command.flags, command.flag_index, names, type, description,
+                    required, choices);
     }
 }
 
-const FlagDef* CliExecutor::find_flag(const std::string& name,
-                                      const std::vector<FlagDef>& command_flags) const {
+const FlagDef* CliExecutor::find_flag(std::string_view name,
+                                      const std::vector<std::uint32_t>& path) const {
     // Check command-specific flags first
-    for (const auto& flag : command_flags) {
-        if (flag.short_name == name || flag.long_name == name) {
-            return &flag;
+    for (std::uint32_t id : path) {
+        const CommandDef& command = commands_[id];
+        if (const FlagDef* flag = command.flag_index.find(name, command.flags)) {
+            return flag;
         }
     }
     // Check global flags
-    for (const auto& flag : global_flags_) {
-        if (flag.short_name == name || flag.long_name == name) {
-            return &flag;
-        }
-    }
-    return nullptr;
+    return global_index_.find(name, global_flags_);
 }
 
-std::string CliExecutor::canonical_name(const FlagDef& flag) {
+std::string_view CliExecutor::canonical_name(const FlagDef& flag) {
     return flag.long_name.empty() ? flag.short_name : flag.long_name;
 }
 
 ParseResult CliExecutor::parse(int argc, char* argv[]) const {
-    std::vector<std::string> args;
-    for (int i = 1; i < argc; ++i) {
-        args.push_back(argv[i]);
-    }
-    return parse(args);
+    return materialize(parse_view(argc, argv));
 }
 
 ParseResult CliExecutor::parse(const std::vector<std::string>& args) const {
+    std::vector<std::string_view> views(args.begin(), args.end());
+    return materialize(parse_args(views));
+}
+
+ParseResult CliExecutor::materialize(ParseView view) {
     ParseResult result;
-    result.success = true;
-    
-    // Command-less mode: if we have a default handler and no commands
-    bool commandless_mode = default_handler_ && commands_.empty();
-    
-    if (args.empty()) {
-        if (!commandless_mode) {
-            result.success = false;
-            result.error_message = "No command specified";
+    result.success = view.success;
+    result.error_message = std::move(view.error_message);
+    for (auto part : view.command_path) {
+        result.command_path.emplace_back(part);
+    }
+    if (!result.command_path.empty()) {
+        result.command = result.command_path.back();
+    }
+    result.command_id = view.command_id;
+    for (const auto& flag : view.flags) {
+        std::string name(flag.name);
+        if (flag.type == FlagType::Boolean) {
+            result.flags[name] = true;
+        } else if (flag.type == FlagType::MultiArg) {
+            auto values = view.get_args(flag.name);
+            result.flags[name] = std::vector<std::string>(values.begin(), values.end());
+        } else {
+            std::visit([&](const auto& value) {
+                using T = std::decay_t<decltype(value)>;
+                if constexpr (!std::is_same_v<T, std::monostate>) {
+                    result.flags[name] = value;
+                }
+            }, flag.value);
         }
-        return result;
     }
-    
-    size_t i = 0;
-    std::vector<FlagDef> command_flags;
-    const CommandDef* current_command = nullptr;
-    
-    // In command-less mode, all non-flag args are positional
-    if (!commandless_mode && !starts_with(args[0], "-")) {
-        // Parse command hierarchy
-        while (i < args.size() && !starts_with(args[i], "-")) {
-            std::string potential_command = args[i];
-            
-            // Check if this is a command at current level
-            if (result.command_path.empty()) {
-                // Top-level command
-                auto cmd_it = commands_.find(potential_command);
-                if (cmd_it != commands_.end()) {
-                    result.command_path.push_back(potential_command);
-                    current_command = &cmd_it->second;
-                    command_flags = cmd_it->second.flags;
-                    ++i;
-                    
-                    // Check for subcommands
-                    while (i < args.size() && !starts_with(args[i], "-")) {
-                        auto sub_it = current_command->subcommands.find(args[i]);
-                        if (sub_it != current_command->subcommands.end()) {
-                            result.command_path.push_back(args[i]);
-                            current_command = &sub_it->second;
-                            // Accumulate flags from each level
-                            command_flags.insert(command_flags.end(),
-                                               sub_it->second.flags.begin(),
-                                               sub_it->second.flags.end());
-                            ++i;
-                        } else {
-                            // Not a subcommand, must be a positional arg or flag
-                            break;
-                        }
-                    }
-                } else if (!commands_.empty()) {
-                    result.success = false;
-                    result.error_message = "Unknown command: " + potential_command;
-                    return result;
-                } else {
+    for (auto arg : view.positional_args) {
+        result.positional_args.emplace_back(arg);
+    }
+    return result;
+}
+
+ParseView CliExecutor::parse_view(int argc, char* argv[]) const {
+    std::vector<std::string_view> args;
+    if (argc > 1) {
+        args.assign(argv + 1, argv + argc);
+    }
+    return parse_args(args);
+}
+
+namespace {
+bool is_response_file(std::string_view arg) {
+    return arg.size() > 1 && arg[0] == '@';
+}
+
+// Contents of a response file: mapped when it is a regular file, else
+// (a pipe such as @/dev/stdin) read in chunks
+class ResponseFile {
+public:
+    ResponseFile(const ResponseFile&) = delete;
+    ResponseFile& operator=(const ResponseFile&) = delete;
+
+    ~ResponseFile() {
+        if (map_) {
+            ::munmap(map_, size_);
+        }
+    }
+
+    static std::shared_ptr<ResponseFile> open(const std::string& path, int& error) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = errno;
+            return nullptr;
+        }
+        std::shared_ptr<ResponseFile> file(new ResponseFile());
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0;
+        if (ok && S_ISREG(st.st_mode) && st.st_size > 0) {
+            file->size_ = static_cast<size_t>(st.st_size);
+            void* map = ::mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = map != MAP_FAILED;
+            if (ok) {
+                file->map_ = map;
+                ::madvise(map, file->size_, MADV_SEQUENTIAL);
+            }
+        } else if (ok) {
+            file->size_ = 0;
+            char chunk[65536];
+            ssize_t n;
+            while ((n = ::read(fd, chunk, sizeof(chunk))) != 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    ok = false;
                     break;
                 }
+                file->data_.append(chunk, static_cast<size_t>(n));
             }
-            
-            break;
         }
-        
-        // Set the legacy single command field to the full path
-        if (!result.command_path.empty()) {
-            result.command = result.command_path.back();
+        error = ok ? 0 : errno;
+        ::close(fd);
+        return ok ? file : nullptr;
+    }
+
+    std::string_view contents() const {
+        return map_ ? std::string_view(static_cast<const char*>(map_), size_) : data_;
+    }
+
+private:
+    ResponseFile() = default;
+
+    void* map_ = nullptr;
+    size_t size_ = 0;
+    std::string data_;
+};
+
+} // namespace
+
+const std::vector<std::string_view>* expand_response_files(
+    const std::vector<std::string_view>& args, std::vector<std::string_view>& expanded,
+    ParseView& view) {
+    if (std::none_of(args.begin(), args.end(), is_response_file)) {
+        return &args;
+    }
+    expanded.reserve(args.size());
+    for (auto arg : args) {
+        if (!is_response_file(arg)) {
+            expanded.push_back(arg);
+            continue;
+        }
+        std::string path(arg.substr(1));
+        int error = 0;
+        auto file = ResponseFile::open(path, error);
+        if (!file) {
+            view.success = false;
+            view.error_message = "Cannot read response file: " + path + " (" +
+                                 std::strerror(error) + ")";
+            return nullptr;
         }
+        std::string_view text = file->contents();
+        char separator = text.find('\0') != std::string_view::npos ? '\0' : '\n';
+        while (!text.empty()) {
+            size_t end = text.find(separator);
+            std::string_view entry = text.substr(0, end);
+            if (separator == '\n' && !entry.empty() && entry.back() == '\r') {
+                entry.remove_suffix(1);
+            }
+            if (!entry.empty()) {
+                expanded.push_back(entry);
+            }
+            text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+        }
+        view.response_files.push_back(std::move(file));
     }
+    return &expanded;
+}
+
+// The executor's commands and flags as parse_arguments sees them
+class CliExecutor::Grammar {
+public:
+    using Flag = const FlagDef*;
+    static constexpr const char* kTraceName = "CliExecutor::parse";
     
-    // Parse remaining arguments
-    while (i < args.size()) {
-        const std::string& arg = args[i];
-        
-        if (starts_with(arg, "--")) {
-            // Long form flag
-            std::string flag_name;
-            std::string flag_value;
-            
-            size_t eq_pos = arg.find('=');
-            if (eq_pos != std::string::npos) {
-                // --flag=value or --flag=val1,val2
-                flag_name = arg.substr(0, eq_pos);
-                flag_value = arg.substr(eq_pos + 1);
-            } else {
-                flag_name = arg;
-            }
-            
-            const FlagDef* flag_def = find_flag(flag_name, command_flags);
-            if (!flag_def) {
+    explicit Grammar(const CliExecutor& cli) : cli_(cli) {}
+    
+    bool parse_commands(const std::vector<std::string_view>& args, size_t& i,
+                        ParseView& result) {
+        // Command-less mode: if we have a default handler and no commands
+        bool commandless_mode =
+            (cli_.default_handler_ || cli_.view_handler_) && !cli_.has_commands();
+        if (args.empty()) {
+            if (!commandless_mode) {
                 result.success = false;
-                result.error_message = "Unknown flag: " + flag_name;
-                return result;
+                result.error_message = "No command specified";
+                return false;
             }
-            
-            std::string canon = canonical_name(*flag_def);
-            
-            if (flag_def->type == FlagType::Boolean) {
-                result.flags[canon] = true;
-            } else {
-                // MultiArg
-                std::vector<std::string> values;
-                
-                if (!flag_value.empty()) {
-                    // Split comma-separated values
-                    std::stringstream ss(flag_value);
-                    std::string item;
-                    while (std::getline(ss, item, ',')) {
-                        if (!item.empty()) {
-                            values.push_back(item);
-                        }
-                    }
-                } else {
-                    // Collect following non-flag arguments
-                    ++i;
-                    while (i < args.size() && !starts_with(args[i], "-")) {
-                        values.push_back(args[i]);
-                        ++i;
-                    }
-                    --i; // Adjust for loop increment
-                }
-                
-                result.flags[canon] = values;
-            }
-        } else if (starts_with(arg, "-") && arg.length() > 1) {
-            // Short form flag
-            const FlagDef* flag_def = find_flag(arg, command_flags);
-            if (!flag_def) {
+            return true;
+        }
+        // In command-less mode, all non-flag args are positional
+        if (commandless_mode || starts_with(args[0], "-")) {
+            return true;
+        }
+        std::uint32_t current_command = cli_.trie_.find(CommandTrie::kRoot, args[0]);
+        if (current_command == 0) {
+            if (cli_.has_commands()) {
                 result.success = false;
-                result.error_message = "Unknown flag: " + arg;
-                return result;
+                result.error_message = "Unknown command: " + std::string(args[0]);
+                return false;
             }
-            
-            std::string canon = canonical_name(*flag_def);
-            
-            if (flag_def->type == FlagType::Boolean) {
-                result.flags[canon] = true;
-            } else {
-                // MultiArg - collect following non-flag arguments
-                std::vector<std::string> values;
-                ++i;
-                while (i < args.size() && !starts_with(args[i], "-")) {
-                    values.push_back(args[i]);
-                    ++i;
-                }
-                --i; // Adjust for loop increment
-                
-                result.flags[canon] = values;
-            }
-        } else {
-            // Positional argument
-            result.positional_args.push_back(arg);
+            return true;
         }
-        
+        result.command_path.push_back(args[0]);
+        cli_.expand(current_command);
+        chain_.push_back(current_command);
         ++i;
+        
+        // Check for subcommands
+        while (i < args.size() && !starts_with(args[i], "-")) {
+            std::uint32_t sub = cli_.trie_.find(current_command, args[i]);
+            if (sub == 0) {
+                // Not a subcommand, must be a positional arg or flag
+                break;
+            }
+            result.command_path.push_back(args[i]);
+            current_command = sub;
+            cli_.expand(current_command);
+            // Accumulate flags from each level
+            chain_.push_back(current_command);
+            ++i;
+        }
+        result.command_id = current_command;
+        return true;
     }
     
-    // Check required flags
-    auto check_required = [&](const std::vector<FlagDef>& flags) {
-        for (const auto& flag : flags) {
-            if (flag.required) {
-                std::string canon = canonical_name(flag);
-                if (!result.has_flag(canon)) {
-                    result.success = false;
-                    result.error_message = "Missing required flag: " + canon;
-                    return false;
+    bool find_flag(std::string_view name, Flag& flag) const {
+        flag = cli_.find_flag(name, chain_);
+        return flag != nullptr;
+    }
+    
+    std::string_view canonical(Flag flag) const { return canonical_name(*flag); }
+    
+    FlagType type(Flag flag) const { return flag->type; }
+    
+    bool convert(Flag flag, std::string_view text, TypedValue& out) const {
+        return convert_value(*flag, text, out);
+    }
+    
+    std::string value_name(Flag flag) const { return cli::value_name(*flag); }
+    
+    std::string_view missing_required(const ParseView& result) const {
+        auto missing = [&result](const std::vector<FlagDef>& flags) {
+            for (const auto& flag : flags) {
+                if (flag.required && !result.has_flag(canonical_name(flag))) {
+                    return canonical_name(flag);
                 }
             }
+            return std::string_view();
+        };
+        std::string_view name = missing(cli_.global_flags_);
+        for (size_t level = 0; name.empty() && level < chain_.size(); ++level) {
+            name = missing(cli_.commands_[chain_[level]].flags);
         }
-        return true;
-    };
-    
-    if (!check_required(global_flags_)) return result;
-    if (!check_required(command_flags)) return result;
+        return name;
+    }
     
-    return result;
+private:
+    const CliExecutor& cli_;
+    std::vector<std::uint32_t> chain_;  // Each level's flags apply
+};
+
+ParseView CliExecutor::parse_args(const std::vector<std::string_view>& args) const {
+    Grammar grammar(*this);
+    return parse_arguments(args, grammar);
 }
 
 int CliExecutor::execute(const ParseResult& result) const {
+    CLI_TRACE_SPAN("CliExecutor::execute");
     if (!result.success) {
         return -1;
     }
@@ -417,25 +927,100 @@ int CliExecutor::execute(const ParseResult& result) const {
         return -1;
     }
     
-    // Find the command using the path
-    const CommandDef* cmd = find_command(result.command_path);
-    if (!cmd || !cmd->callback) {
+    // Use the command resolved while parsing; look the path up only for
+    // results that were not produced by parse()
+    std::uint32_t id = result.command_id;
+    if (id == 0 || id >= commands_.size()) {
+        id = find_command(result.command_path);
+    }
+    if (id == 0 || !commands_[id].callback) {
         // Command exists but has no callback - show help for this level
         std::printf("%s", help(result.command_path).c_str());
         return 0;
     }
     
-    return cmd->callback(result);
+    return commands_[id].callback(result);
+}
+
+int run_command_line(int argc, char* argv[], const std::string& program,
+                     std::chrono::steady_clock::time_point start,
+                     const std::function<bool(std::string_view)>& has_global_flag,
+                     const CommandLineRunner& run) {
+    std::vector<std::string_view> args;
+    if (argc > 1) {
+        args.assign(argv + 1, argv + argc);
+    }
+    // Hidden --serve[=SOCKET] and --profile[=FILE] are only recognised as
+    // the first argument, so flag values and command flags are left alone
+    std::string_view first = args.empty() ? std::string_view() : args[0];
+    if (!has_global_flag("--serve") &&
+        (first == "--serve" || starts_with(first, "--serve="))) {
+        return serve(first.size() > 8 ? std::string(first.substr(8)) : "-",
+                     [&run](const std::vector<std::string_view>& request) {
+                         return run(request, nullptr);
+                     });
+    }
+    if (!has_global_flag("--profile") &&
+        (first == "--profile" || starts_with(first, "--profile="))) {
+        std::string json_path(first.substr(std::min<size_t>(first.size(), 10)));
+        args.erase(args.begin());
+        Profiler profiler(start);
+        int code = run(args, &profiler);
+        profiler.report(program, json_path);
+        return code;
+    }
+    return run(args, nullptr);
 }
 
 int CliExecutor::run(int argc, char* argv[]) const {
-    auto result = parse(argc, argv);
+    return run_command_line(
+        argc, argv, program_name_, created_,
+        [this](std::string_view name) {
+            return global_index_.find(name, global_flags_) != nullptr;
+        },
+        [this](const std::vector<std::string_view>& args, Profiler* profiler) {
+            return run_args(args, profiler);
+        });
+}
+
+int CliExecutor::run_args(const std::vector<std::string_view>& args,
+                          Profiler* profiler) const {
+    // Zero-copy path: the handler reads views straight into the arguments
+    if (view_handler_ && !has_commands()) {
+        auto view = parse_args(args);
+        if (profiler) {
+            profiler->end_phase("parse");
+        }
+        if (!view.success) {
+            std::fprintf(stderr, "Error: %s\n", view.error_message.c_str());
+            std::fprintf(stderr, "Use --help for usage information.\n");
+            return -1;
+        }
+        if (view.get_bool("--help")) {
+            std::printf("%s", help().c_str());
+            return 0;
+        }
+        int code = view_handler_(view);
+        if (profiler) {
+            profiler->end_phase("execute");
+        }
+        return code;
+    }
+    
+    auto result = materialize(parse_args(args));
+    if (profiler) {
+        profiler->end_phase("parse");
+    }
     if (!result.success) {
         std::fprintf(stderr, "Error: %s\n", result.error_message.c_str());
         std::fprintf(stderr, "Use --help for usage information.\n");
         return -1;
     }
-    return execute(result);
+    int code = execute(result);
+    if (profiler) {
+        profiler->end_phase("execute");
+    }
+    return code;
 }
 
 std::string CliExecutor::help() const {
@@ -449,18 +1034,18 @@ std::string CliExecutor::help() const {
     // Use custom usage if set, otherwise generate based on mode
     if (!usage_.empty()) {
         ss << "Usage: " << program_name_ << " " << usage_ << "\n\n";
-    } else if (commands_.empty()) {
+    } else if (!has_commands()) {
         ss << "Usage: " << program_name_ << " [options] [args...]\n\n";
     } else {
         ss << "Usage: " << program_name_ << " <command> [options]\n\n";
     }
     
-    if (!commands_.empty()) {
+    if (has_commands()) {
         ss << "Commands:\n";
-        for (const auto& [name, cmd] : commands_) {
-            ss << "  " << name;
-            if (!cmd.description.empty()) {
-                ss << "\t" << cmd.description;
+        for (std::uint32_t id : trie_.children(CommandTrie::kRoot)) {
+            ss << "  " << trie_.name(id);
+            if (!commands_[id].description.empty()) {
+                ss << "\t" << commands_[id].description;
             }
             ss << "\n";
         }
@@ -470,26 +1055,7 @@ std::string CliExecutor::help() const {
     if (!global_flags_.empty()) {
         ss << "Options:\n";
         for (const auto& flag : global_flags_) {
-            ss << "  ";
-            if (!flag.short_name.empty()) {
-                ss << flag.short_name;
-                if (!flag.long_name.empty()) {
-                    ss << ", ";
-                }
-            }
-            if (!flag.long_name.empty()) {
-                ss << flag.long_name;
-            }
-            if (flag.type == FlagType::MultiArg) {
-                ss << " <args>";
-            }
-            if (!flag.description.empty()) {
-                ss << "\t" << flag.description;
-            }
-            if (flag.required) {
-                ss << " (required)";
-            }
-            ss << "\n";
+            ss << flag_help_line(flag);
         }
     }
     
@@ -501,8 +1067,8 @@ std::string CliExecutor::help(const std::string& command_name) const {
 }
 
 std::string CliExecutor::help(const std::vector<std::string>& command_path) const {
-    const CommandDef* cmd = find_command(command_path);
-    if (!cmd) {
+    std::uint32_t id = find_command(command_path);
+    if (id == 0) {
         std::string path_str;
         for (size_t i = 0; i < command_path.size(); ++i) {
             if (i > 0) path_str += " ";
@@ -519,6 +1085,7 @@ std::string CliExecutor::help(const std::vector<std::string>& command_path) cons
         cmd_str += " " + part;
     }
     
+    const CommandDef* cmd = &commands_[id];
     ss << cmd_str;
     if (!cmd->description.empty()) {
         ss << " - " << cmd->description;
@@ -526,18 +1093,18 @@ std::string CliExecutor::help(const std::vector<std::string>& command_path) cons
     ss << "\n\n";
     
     ss << "Usage: " << cmd_str;
-    if (!cmd->subcommands.empty()) {
+    if (trie_.has_children(id)) {
         ss << " <subcommand>";
     }
     ss << " [options]\n\n";
     
     // Show subcommands if any
-    if (!cmd->subcommands.empty()) {
+    if (trie_.has_children(id)) {
         ss << "Subcommands:\n";
-        for (const auto& [name, subcmd] : cmd->subcommands) {
-            ss << "  " << name;
-            if (!subcmd.description.empty()) {
-                ss << "\t" << subcmd.description;
+        for (std::uint32_t sub : trie_.children(id)) {
+            ss << "  " << trie_.name(sub);
+            if (!commands_[sub].description.empty()) {
+                ss << "\t" << commands_[sub].description;
             }
             ss << "\n";
         }
@@ -547,26 +1114,7 @@ std::string CliExecutor::help(const std::vector<std::string>& command_path) cons
     if (!cmd->flags.empty()) {
         ss << "Command Options:\n";
         for (const auto& flag : cmd->flags) {
-            ss << "  ";
-            if (!flag.short_name.empty()) {
-                ss << flag.short_name;
-                if (!flag.long_name.empty()) {
-                    ss << ", ";
-                }
-            }
-            if (!flag.long_name.empty()) {
-                ss << flag.long_name;
-            }
-            if (flag.type == FlagType::MultiArg) {
-                ss << " <args>";
-            }
-            if (!flag.description.empty()) {
-                ss << "\t" << flag.description;
-            }
-            if (flag.required) {
-                ss << " (required)";
-            }
-            ss << "\n";
+            ss << flag_help_line(flag);
         }
         ss << "\n";
     }
@@ -574,26 +1122,7 @@ std::string CliExecutor::help(const std::vector<std::string>& command_path) cons
     if (!global_flags_.empty()) {
         ss << "Global Options:\n";
         for (const auto& flag : global_flags_) {
-            ss << "  ";
-            if (!flag.short_name.empty()) {
-                ss << flag.short_name;
-                if (!flag.long_name.empty()) {
-                    ss << ", ";
-                }
-            }
-            if (!flag.long_name.empty()) {
-                ss << flag.long_name;
-            }
-            if (flag.type == FlagType::MultiArg) {
-                ss << " <args>";
-            }
-            if (!flag.description.empty()) {
-                ss << "\t" << flag.description;
-            }
-            if (flag.required) {
-                ss << " (required)";
-            }
-            ss << "\n";
+            ss << flag_help_line(flag);
         }
     }
     
@@ -1,4 +1,5 @@
 #include "fullscreen_terminal.hpp"
+#include "trace.hpp"
 
 #include <chrono>
 #include <cstdio>
@@ -102,6 +103,7 @@ void FullscreenTerminal::clear() {
 void FullscreenTerminal::force_redraw() { force_redraw_ = true; }
 
 void FullscreenTerminal::flush() {
+  CLI_TRACE_SPAN("FullscreenTerminal::flush");
   if (!in_fullscreen_) {
     return;
   }
@@ -1,22 +1,75 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+#include "serve.hpp"
+
 namespace cli {
 
-/// Type of flag: boolean (no arguments) or multi-argument
+/// Type of flag: boolean, multi-argument, or one typed value. Typed values
+/// are converted while parsing, so a bad value is a parse error.
 enum class FlagType {
-  Boolean,  // Flag is present or not (e.g., -v, --verbose)
-  MultiArg  // Flag takes one or more arguments (e.g., -f file1 file2)
+  Boolean,   // Flag is present or not (e.g., -v, --verbose)
+  MultiArg,  // Flag takes one or more arguments (e.g., -f file1 file2)
+  Int64,     // std::int64_t (e.g., -n -5)
+  UInt64,    // std::uint64_t
+  Double,    // double
+  Size,      // std::uint64_t bytes, optional K/M/G/T suffix (powers of 1024)
+  Duration,  // std::chrono::nanoseconds, unit ns/us/ms/s/m/h (default s)
+  Enum       // Choice: one of the flag's declared choices
+};
+
+/// Name of the value a flag takes, as shown in help (e.g., "size")
+constexpr std::string_view flag_type_name(FlagType type) {
+  switch (type) {
+    case FlagType::Boolean:
+      return "";
+    case FlagType::MultiArg:
+      return "args";
+    case FlagType::Int64:
+      return "integer";
+    case FlagType::UInt64:
+      return "count";
+    case FlagType::Double:
+      return "number";
+    case FlagType::Size:
+      return "size";
+    case FlagType::Duration:
+      return "duration";
+    case FlagType::Enum:
+      return "choice";
+  }
+  return "";
+}
+
+/// Value of an Enum flag: the index of the matching declared choice
+struct Choice {
+  std::size_t index = 0;
+
+  bool operator==(const Choice& other) const { return index == other.index; }
 };
 
+/// Converted value of a typed flag (monostate for untyped flags)
+using TypedValue = std::variant<std::monostate, std::int64_t, std::uint64_t,
+                                double, std::chrono::nanoseconds, Choice>;
+
 /// Parsed value for a flag
-using FlagValue = std::variant<bool, std::vector<std::string>>;
+using FlagValue =
+    std::variant<bool, std::vector<std::string>, std::int64_t, std::uint64_t,
+                 double, std::chrono::nanoseconds, Choice>;
+
+/// Convert the text of an Int64, UInt64, Double, Size or Duration value
+/// @return false unless the whole text is a valid value of that type
+bool parse_flag_value(FlagType type, std::string_view text, TypedValue& out);
 
 /// Result of parsing command line arguments
 struct ParseResult {
@@ -24,6 +77,7 @@ struct ParseResult {
   std::string error_message;
   std::string command;
   std::vector<std::string> command_path;  // Full path of nested commands
+  std::uint32_t command_id = 0;  // Resolved command in the executor (0 = none)
   std::map<std::string, FlagValue> flags;
   std::vector<std::string> positional_args;
 
@@ -35,8 +89,95 @@ struct ParseResult {
 
   /// Check if a flag was provided
   bool has_flag(const std::string& flag_name) const;
+
+  /// Get a typed flag value (std::uint64_t for UInt64 and Size flags,
+  /// std::chrono::nanoseconds for Duration, Choice for Enum)
+  /// @return nullopt if not set or of another type
+  template <typename T>
+  std::optional<T> get(const std::string& flag_name) const {
+    auto it = flags.find(flag_name);
+    if (it == flags.end()) return std::nullopt;
+    if (auto* val = std::get_if<T>(&it->second)) {
+      return *val;
+    }
+    return std::nullopt;
+  }
+};
+
+/// Read-only view of consecutive parsed values (a minimal C++17 span)
+class ArgSpan {
+ public:
+  ArgSpan() = default;
+  ArgSpan(const std::string_view* data, std::size_t size)
+      : data_(data), size_(size) {}
+
+  const std::string_view* begin() const { return data_; }
+  const std::string_view* end() const { return data_ + size_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string_view operator[](std::size_t i) const { return data_[i]; }
+
+ private:
+  const std::string_view* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+/// Result of parsing without copying: every string is a view into argv
+/// (or into the flag definitions), so parsing allocates a handful of
+/// vectors regardless of the number of arguments. Must not outlive argv.
+struct ParseView {
+  /// One parsed flag; MultiArg values are values[first, first + count)
+  struct Flag {
+    std::string_view name;  // Canonical name (long name if there is one)
+    FlagType type;
+    std::uint32_t first = 0;
+    std::uint32_t count = 0;
+    TypedValue value;  // Converted value of a typed flag
+  };
+
+  bool success = false;
+  std::string error_message;
+  std::vector<std::string_view> command_path;
+  std::uint32_t command_id = 0;  // Resolved command in the executor (0 = none)
+  std::vector<Flag> flags;  // One entry per distinct flag given
+  std::vector<std::string_view> values;
+  std::vector<std::string_view> positional_args;
+  // Contents of @file arguments, which the views above may point into
+  std::vector<std::shared_ptr<const void>> response_files;
+
+  /// Get boolean flag value (returns false if not set or wrong type)
+  bool get_bool(std::string_view flag_name) const;
+
+  /// Get multi-arg flag values (empty if not set or wrong type)
+  ArgSpan get_args(std::string_view flag_name) const;
+
+  /// Check if a flag was provided
+  bool has_flag(std::string_view flag_name) const;
+
+  /// Get a typed flag value (see ParseResult::get)
+  template <typename T>
+  std::optional<T> get(std::string_view flag_name) const {
+    const Flag* flag = find(flag_name);
+    if (!flag) return std::nullopt;
+    if (auto* val = std::get_if<T>(&flag->value)) {
+      return *val;
+    }
+    return std::nullopt;
+  }
+
+ private:
+  const Flag* find(std::string_view flag_name) const;
 };
 
+/// Replace each "@path" argument by the entries of that response file (see
+/// CliExecutor::parse); the files are kept alive in view.response_files
+/// @return The arguments to parse: args itself if none is a response file,
+///         else expanded; nullptr with view's error set if a file cannot
+///         be read
+const std::vector<std::string_view>* expand_response_files(
+    const std::vector<std::string_view>& args,
+    std::vector<std::string_view>& expanded, ParseView& view);
+
 /// Flag definition
 struct FlagDef {
   std::string short_name;  // e.g., "-v"
@@ -44,17 +185,163 @@ struct FlagDef {
   FlagType type;
   std::string description;
   bool required = false;
+  std::vector<std::string> choices;  // Accepted values of an Enum flag
+};
+
+/// Open-addressing hash table from flag names (short and long) to their
+/// position in a flag list. Filled as flags are registered, so parsing
+/// resolves each flag with one hash and usually one probe, without
+/// allocating. Slots hold only a hash and a position; names are compared
+/// against the FlagDef itself.
+class FlagIndex {
+ public:
+  /// Index both names of flags[position] (first registration of a name wins)
+  void insert(const std::vector<FlagDef>& flags, std::uint32_t position);
+
+  /// Find a flag by short or long name
+  /// @return The flag, or nullptr if no flag has that name
+  const FlagDef* find(std::string_view name,
+                      const std::vector<FlagDef>& flags) const;
+
+ private:
+  struct Slot {
+    std::uint32_t hash = 0;
+    std::uint32_t value = 0;  // Index into the flag list plus one; 0 = empty
+  };
+
+  void insert_name(std::string_view name, const std::vector<FlagDef>& flags,
+                   std::uint32_t position);
+  void grow();
+
+  std::vector<Slot> slots_;  // Power-of-two size, at most half full
+  std::size_t used_ = 0;
 };
 
 /// Command definition with callback
 using CommandCallback = std::function<int(const ParseResult&)>;
 
+/// Handler for command-less tools that read a ParseView
+using ViewCallback = std::function<int(const ParseView&)>;
+
+class CliExecutor;
+class CommandBuilder;
+class Profiler;
+
+/// Fills in a lazily registered command (see add_lazy_command)
+using CommandFactory = std::function<void(CommandBuilder&)>;
+
+/// Parses and executes one command line (arguments without the program
+/// name), telling profiler, if set, when the parse and execute phases end
+using CommandLineRunner =
+    std::function<int(const std::vector<std::string_view>&, Profiler*)>;
+
+/// Entry point shared by CliExecutor::run and StaticCli::run: run argv
+/// (skipping the program name), or handle the hidden flags documented at
+/// CliExecutor::run, each unless has_global_flag says the tool declares it
+/// @param start Start of the register phase reported by --profile
+int run_command_line(int argc, char* argv[], const std::string& program,
+                     std::chrono::steady_clock::time_point start,
+                     const std::function<bool(std::string_view)>& has_global_flag,
+                     const CommandLineRunner& run);
+
+/// Command tree in flat arrays. Commands are numbered (0 is the root,
+/// meaning "no command") and refer to each other by index, names are
+/// interned in one pool, and an open-addressing table maps (parent, name)
+/// to the child, so resolving each level of a path touches one slot, one
+/// 20-byte node and the name bytes, whatever the size of the tree.
+class CommandTrie {
+ public:
+  static constexpr std::uint32_t kRoot = 0;
+
+  CommandTrie();
+
+  /// Find a child of parent by name
+  /// @return The child's index, or 0 if there is none
+  std::uint32_t find(std::uint32_t parent, std::string_view name) const;
+
+  /// Find a child of parent by name, adding it if missing
+  std::uint32_t insert(std::uint32_t parent, std::string_view name);
+
+  std::string_view name(std::uint32_t command) const;
+  std::uint32_t parent(std::uint32_t command) const {
+    return nodes_[command].parent;
+  }
+  bool has_children(std::uint32_t command) const {
+    return nodes_[command].first_child != 0;
+  }
+  std::size_t size() const { return nodes_.size(); }
+
+  /// Children of a command ordered by name (for help)
+  std::vector<std::uint32_t> children(std::uint32_t command) const;
+
+ private:
+  struct Node {
+    std::uint32_t parent = 0;
+    std::uint32_t name = 0;  // Offset of the name in names_
+    std::uint32_t name_size = 0;
+    std::uint32_t first_child = 0;   // 0 = none
+    std::uint32_t next_sibling = 0;  // 0 = none
+  };
+
+  struct Slot {
+    std::uint32_t hash = 0;
+    std::uint32_t value = 0;  // Node index or name offset plus one; 0 = empty
+  };
+
+  std::uint32_t intern(std::string_view name);
+
+  std::vector<Node> nodes_;
+  std::string names_;            // Interned names, each followed by '\0'
+  std::vector<Slot> children_;   // (parent, name) -> node
+  std::vector<Slot> name_slots_; // name -> offset in names_
+  std::size_t name_count_ = 0;
+};
+
+/// Registration data of one command, indexed like the CommandTrie nodes
 struct CommandDef {
-  std::string name;
   std::string description;
   CommandCallback callback;
   std::vector<FlagDef> flags;
-  std::map<std::string, CommandDef> subcommands;  // Nested subcommands
+  FlagIndex flag_index;  // Lookup table over flags
+  CommandFactory factory;  // Set until a lazy command is expanded
+};
+
+/// Registers callbacks, flags and subcommands below one command; passed
+/// to the factory of a lazy command. Paths are dot-separated and relative
+/// to that command.
+class CommandBuilder {
+ public:
+  /// Set the callback of the command itself
+  void set_callback(CommandCallback callback);
+
+  /// Add a flag to the command itself
+  void add_flag(const std::string& names, FlagType type,
+                const std::string& description = "", bool required = false,
+                const std::vector<std::string>& choices = {});
+
+  /// Add a subcommand (e.g., "day-1.part-1")
+  void add_command(const std::string& path, const std::string& description,
+                   CommandCallback callback);
+
+  /// Add a subcommand whose own subtree is built on first use
+  void add_lazy_command(const std::string& path,
+                        const std::string& description,
+                        CommandFactory factory);
+
+  /// Add a flag to a subcommand
+  void add_command_flag(const std::string& path, const std::string& names,
+                        FlagType type, const std::string& description = "",
+                        bool required = false,
+                        const std::vector<std::string>& choices = {});
+
+ private:
+  friend class CliExecutor;
+
+  CommandBuilder(const CliExecutor& executor, std::uint32_t command)
+      : executor_(executor), command_(command) {}
+
+  const CliExecutor& executor_;
+  std::uint32_t command_;
 };
 
 /// CLI Executor - main class for parsing and executing commands
@@ -70,13 +357,20 @@ class CliExecutor {
   /// @param type Flag type (Boolean or MultiArg)
   /// @param description Help text for the flag
   /// @param required Whether the flag is required
+  /// @param choices Accepted values of an Enum flag
   void add_flag(const std::string& names, FlagType type,
-                const std::string& description = "", bool required = false);
+                const std::string& description = "", bool required = false,
+                const std::vector<std::string>& choices = {});
 
   /// Set handler for command-less mode (just positional args + flags)
   /// @param callback Function to execute with parsed args
   void set_handler(CommandCallback callback);
 
+  /// Set a command-less handler that receives a zero-copy ParseView.
+  /// run() then parses without copying argv; use for tools that take
+  /// very many arguments.
+  void set_view_handler(ViewCallback callback);
+
   /// Add a command (for multi-command CLIs)
   /// @param name Command name
   /// @param description Help text for the command
@@ -92,19 +386,37 @@ class CliExecutor {
                           const std::string& description,
                           CommandCallback callback);
 
+  /// Add a nested command whose subtree (subcommands, flags, callback) is
+  /// registered by factory only when parsing, execution or help first
+  /// reaches it, so startup cost grows with the depth of the command that
+  /// is run rather than with the size of the tree. Factories run at most
+  /// once; parsing that expands a subtree is not thread-safe.
+  /// @param command_path Dot-separated path (e.g., "year-2025")
+  /// @param description Help text for the command
+  /// @param factory Called with a builder rooted at the new command
+  void add_lazy_command(const std::string& command_path,
+                        const std::string& description, CommandFactory factory);
+
   /// Add a flag specific to a command
   void add_command_flag(const std::string& command_name,
                         const std::string& names, FlagType type,
                         const std::string& description = "",
-                        bool required = false);
+                        bool required = false,
+                        const std::vector<std::string>& choices = {});
 
   /// Add a flag to a nested command using dot-separated path
   void add_nested_command_flag(const std::string& command_path,
                                const std::string& names, FlagType type,
                                const std::string& description = "",
-                               bool required = false);
-
-  /// Parse command line arguments
+                               bool required = false,
+                               const std::vector<std::string>& choices = {});
+
+  /// Parse command line arguments. An argument "@path" is replaced by the
+  /// entries of that response file, which are parsed as if given on the
+  /// command line: NUL-separated if the file contains a NUL (find -print0),
+  /// else one per line; empty entries are skipped and entries are not
+  /// expanded again. Files are mapped rather than copied, so they may hold
+  /// more arguments than ARG_MAX allows.
   /// @param argc Argument count
   /// @param argv Argument values
   /// @return ParseResult with parsed values or error
@@ -113,13 +425,37 @@ class CliExecutor {
   /// Parse from vector of strings (useful for testing)
   ParseResult parse(const std::vector<std::string>& args) const;
 
+  /// Parse without copying arguments; the result refers into argv and
+  /// into the response files it keeps mapped
+  ParseView parse_view(int argc, char* argv[]) const;
+
   /// Execute the parsed command
   /// @return Exit code from command callback, or -1 on error
   int execute(const ParseResult& result) const;
 
-  /// Parse and execute in one call
+  /// Parse and execute in one call. Unless the tool defines global flags of
+  /// the same name, two hidden flags are recognised, and only as the first
+  /// argument: "--serve" runs serve("-") and "--serve=SOCKET" runs
+  /// serve(SOCKET) instead, and "--profile[=FILE]" times the register,
+  /// parse and execute phases and reports them with hardware counters and
+  /// resource usage on stderr, or as JSON to FILE (see Profiler).
   int run(int argc, char* argv[]) const;
 
+  /// Run many command lines in this process, so repeated invocations skip
+  /// process startup and keep lazily expanded commands warm. Each request
+  /// is parsed and executed like run() with stdout and stderr captured, and
+  /// answered with the exit code and output (see ServeFraming). Requests
+  /// are handled one at a time; a client connection may send several.
+  /// @param endpoint Unix socket path to listen on, or "-" to read
+  ///        requests from stdin and answer on stdout
+  /// @return 0 when stdin ends; -1 if the endpoint cannot be set up
+  ///         (a socket server otherwise runs until killed)
+  int serve(const std::string& endpoint) const;
+
+  /// Serve requests read from in_fd, writing responses to out_fd, until
+  /// in_fd ends or a response cannot be written
+  int serve_stream(int in_fd, int out_fd, ServeFraming framing) const;
+
   /// Generate help text
   std::string help() const;
 
@@ -130,27 +466,65 @@ class CliExecutor {
   std::string help(const std::vector<std::string>& command_path) const;
 
  private:
+  friend class CommandBuilder;
+
   std::string program_name_;
   std::string description_;
   std::string usage_;
   std::vector<FlagDef> global_flags_;
-  std::map<std::string, CommandDef> commands_;
+  FlagIndex global_index_;
+  // Mutable because lazy commands are expanded by const parse and help
+  mutable CommandTrie trie_;
+  mutable std::vector<CommandDef> commands_;  // Indexed like trie_
   CommandCallback default_handler_;
+  ViewCallback view_handler_;
+  // Start of the register phase reported by --profile
+  std::chrono::steady_clock::time_point created_ = std::chrono::steady_clock::now();
 
   /// Parse flag names string into short and long names
   static std::pair<std::string, std::string> parse_flag_names(
       const std::string& names);
 
-  /// Find flag definition by name (short or long)
-  const FlagDef* find_flag(const std::string& name,
-                           const std::vector<FlagDef>& command_flags) const;
+  /// Register a flag in a flag list and its index
+  static void add_flag_to(std::vector<FlagDef>& flags, FlagIndex& index,
+                          const std::string& names, FlagType type,
+                          const std::string& description, bool required,
+                          const std::vector<std::string>& choices);
+
+  /// Find flag definition by name (short or long), checking the commands
+  /// on the path outermost first, then the global flags
+  const FlagDef* find_flag(std::string_view name,
+                           const std::vector<std::uint32_t>& path) const;
 
   /// Get canonical name for a flag (prefers long name)
-  static std::string canonical_name(const FlagDef& flag);
+  static std::string_view canonical_name(const FlagDef& flag);
+
+  /// Parse and execute arguments (shared by run and serve)
+  /// @param profiler Told when the parse and execute phases end, if set
+  int run_args(const std::vector<std::string_view>& args,
+               Profiler* profiler = nullptr) const;
+
+  /// The commands and flags as parse_arguments sees them
+  class Grammar;
+
+  /// Parse views of the arguments (shared by every parse entry point)
+  ParseView parse_args(const std::vector<std::string_view>& args) const;
+
+  /// Convert a view into an owning ParseResult
+  static ParseResult materialize(ParseView view);
+
+  /// Find command by path, expanding lazy commands on it (0 if not found)
+  std::uint32_t find_command(const std::vector<std::string>& path) const;
+
+  /// Find or create the command at a non-empty path below parent,
+  /// expanding the lazy commands passed through on the way
+  std::uint32_t ensure_command(std::uint32_t parent,
+                               const std::vector<std::string>& parts) const;
+
+  /// Run a lazy command's factory, once
+  void expand(std::uint32_t command) const;
 
-  /// Find command by path (returns nullptr if not found)
-  CommandDef* find_command(const std::vector<std::string>& path);
-  const CommandDef* find_command(const std::vector<std::string>& path) const;
+  bool has_commands() const { return trie_.has_children(CommandTrie::kRoot); }
 
   /// Split command path string by delimiter
   static std::vector<std::string> split_path(const std::string& path, char delimiter = '.');
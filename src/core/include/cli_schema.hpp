@@ -0,0 +1,732 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cli.hpp"
+#include "parse_arguments.hpp"
+#include "profile.hpp"
+
+namespace cli {
+
+/// Handler of a schema command; a plain function so schemas are constexpr
+using ViewHandler = int (*)(const ParseView&);
+
+/// Flag declared in a schema
+struct FlagSpec {
+  std::string_view names;  // Comma-separated, e.g. "-v,--verbose"
+  FlagType type = FlagType::Boolean;
+  std::string_view description = {};
+  bool required = false;
+  std::string_view command = {};  // Dot-separated command path; empty = global
+  std::string_view choices = {};  // Enum choices, e.g. "none|atomic|fsync"
+};
+
+/// Command declared in a schema
+struct CommandSpec {
+  std::string_view path;  // Dot-separated, e.g. "remote.add"
+  std::string_view description = {};
+  ViewHandler handler = nullptr;  // nullptr shows the command's help
+};
+
+/// Program name, help text and command-less handler of a schema
+struct ProgramSpec {
+  std::string_view name;
+  std::string_view description = {};
+  ViewHandler handler = nullptr;  // Used when the schema has no commands
+  std::string_view usage = {};    // e.g. "<source> <dest>"
+};
+
+namespace detail {
+
+/// Fail schema construction. In a constant expression this is a compile
+/// error that points here, with the message in the diagnostic.
+constexpr void schema_check(bool ok, const char* message) {
+  if (!ok) {
+    throw std::logic_error(message);
+  }
+}
+
+constexpr std::string_view sv_trim(std::string_view str) {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+/// Help sink that only measures
+struct HelpCounter {
+  std::size_t size = 0;
+  constexpr void put(std::string_view text) { size += text.size(); }
+  constexpr void put(char) { ++size; }
+};
+
+/// Help sink that writes into a fixed buffer sized by HelpCounter
+template <std::size_t N>
+struct HelpWriter {
+  std::array<char, N>& text;
+  std::size_t pos = 0;
+  constexpr void put(std::string_view str) {
+    for (char c : str) {
+      text[pos++] = c;
+    }
+  }
+  constexpr void put(char c) { text[pos++] = c; }
+};
+
+}  // namespace detail
+
+/// Command tree and flags declared as constexpr data. The constructor
+/// validates the declarations and builds sorted lookup tables, so in a
+/// constexpr Schema a duplicate flag, a malformed flag name or a flag on an
+/// undeclared command is a compile error, and startup does no registration
+/// work. Build one with make_schema() and run it with StaticCli.
+///
+/// Parsing follows CliExecutor: the same flag syntax, @file response files,
+/// the outermost command's flag wins over inner ones and global flags, a
+/// built-in -h/--help, typed flag values, and the same error messages.
+template <std::size_t NC, std::size_t NF>
+class Schema {
+ public:
+  static constexpr std::size_t kNone = static_cast<std::size_t>(-1);
+  static constexpr std::size_t kFlags = NF + 1;  // Plus the built-in --help
+
+  constexpr Schema(const ProgramSpec& program, const CommandSpec* commands,
+                   const FlagSpec* flags)
+      : program_(program) {
+    for (std::size_t i = 0; i < NC; ++i) {
+      commands_[i] = commands[i];
+      std::string_view path = commands[i].path;
+      std::size_t dot = path.rfind('.');
+      command_name_[i] = dot == std::string_view::npos ? path
+                                                        : path.substr(dot + 1);
+      detail::schema_check(!command_name_[i].empty(), "Empty command name");
+    }
+    for (std::size_t i = 0; i < NC; ++i) {
+      std::string_view path = commands_[i].path;
+      std::size_t dot = path.rfind('.');
+      parent_[i] = dot == std::string_view::npos
+                       ? kNone
+                       : find_command(path.substr(0, dot));
+      detail::schema_check(dot == std::string_view::npos || parent_[i] != kNone,
+                           "Parent command is not declared");
+    }
+    sort_commands();
+
+    flags_[0] = {"-h,--help", FlagType::Boolean, "Show help message"};
+    for (std::size_t i = 0; i < NF; ++i) {
+      flags_[i + 1] = flags[i];
+    }
+    for (std::size_t i = 0; i < kFlags; ++i) {
+      split_names(i);
+      scope_[i] = flags_[i].command.empty() ? kNone
+                                            : find_command(flags_[i].command);
+      detail::schema_check(flags_[i].command.empty() || scope_[i] != kNone,
+                           "Flag declared on an unknown command");
+      for (std::string_view name : {short_[i], long_[i]}) {
+        if (!name.empty()) {
+          entries_[entry_count_++] = {name, i};
+        }
+      }
+    }
+    sort_entries();
+  }
+
+  constexpr const ProgramSpec& program() const { return program_; }
+  constexpr std::size_t command_count() const { return NC; }
+
+  /// Canonical name (long name if there is one) of a declared flag. Use in
+  /// constant expressions so a misspelt name fails to compile:
+  ///   constexpr std::string_view kVerbose = kSchema.flag("-v");
+  constexpr std::string_view flag(std::string_view name) const {
+    for (std::size_t i = 0; i < kFlags; ++i) {
+      if (short_[i] == name || long_[i] == name) {
+        return canonical(i);
+      }
+    }
+    detail::schema_check(false, "Unknown flag name");
+    return {};
+  }
+
+  /// Index of a declared command (a compile error in constant expressions
+  /// if there is no such command)
+  constexpr std::size_t command(std::string_view path) const {
+    std::size_t index = find_command(path);
+    detail::schema_check(index != kNone, "Unknown command path");
+    return index;
+  }
+
+  /// Whether a global flag (or the built-in --help) has this name
+  bool has_global_flag(std::string_view name) const {
+    return find_flag(name, {}, 0) != kNone;
+  }
+
+  /// Handler for a command index, or the program handler for kNone
+  constexpr ViewHandler handler(std::size_t command) const {
+    return command == kNone ? program_.handler : commands_[command].handler;
+  }
+
+  /// Write help for a command index, or the program help for NC
+  template <typename Sink>
+  constexpr void write_help(std::size_t page, Sink& sink) const {
+    if (page == NC) {
+      write_program_help(sink);
+    } else {
+      write_command_help(page, sink);
+    }
+  }
+
+  /// Parse arguments (without the program name) into a ParseView. "@path"
+  /// arguments are expanded as by CliExecutor::parse.
+  /// @param command Set to the index of the deepest command given, or kNone
+  ParseView parse(const std::vector<std::string_view>& args,
+                  std::size_t* command = nullptr) const {
+    Grammar grammar{*this};
+    ParseView result = parse_arguments(args, grammar);
+    if (command) {
+      *command = grammar.depth == 0 ? kNone : grammar.chain[grammar.depth - 1];
+    }
+    return result;
+  }
+
+  /// Parse argv (skipping the program name); the result refers into argv
+  ParseView parse(int argc, char* argv[],
+                  std::size_t* command = nullptr) const {
+    std::vector<std::string_view> args;
+    if (argc > 1) {
+      args.assign(argv + 1, argv + argc);
+    }
+    return parse(args, command);
+  }
+
+ private:
+  struct FlagEntry {
+    std::string_view name;
+    std::size_t flag = 0;
+  };
+
+  /// The schema as parse_arguments sees it, with the commands given
+  struct Grammar {
+    using Flag = std::size_t;
+    static constexpr const char* kTraceName = "Schema::parse";
+
+    const Schema& schema;
+    std::array<std::size_t, NC + 1> chain{};  // Outermost command first
+    std::size_t depth = 0;
+
+    bool parse_commands(const std::vector<std::string_view>& args,
+                        std::size_t& i, ParseView& result) {
+      if (args.empty()) {
+        if (NC > 0) {
+          result.success = false;
+          result.error_message = "No command specified";
+          return false;
+        }
+        return true;
+      }
+      if (NC == 0 || detail::sv_starts_with(args[0], "-")) {
+        return true;
+      }
+      std::size_t current = schema.find_child(kNone, args[0]);
+      if (current == kNone) {
+        result.success = false;
+        result.error_message = "Unknown command: " + std::string(args[0]);
+        return false;
+      }
+      while (current != kNone) {
+        result.command_path.push_back(args[i++]);
+        chain[depth++] = current;
+        current = i < args.size() && !detail::sv_starts_with(args[i], "-")
+                      ? schema.find_child(current, args[i])
+                      : kNone;
+      }
+      return true;
+    }
+
+    bool find_flag(std::string_view name, Flag& flag) const {
+      flag = schema.find_flag(name, chain, depth);
+      return flag != kNone;
+    }
+
+    std::string_view canonical(Flag flag) const {
+      return schema.canonical(flag);
+    }
+
+    FlagType type(Flag flag) const { return schema.flags_[flag].type; }
+
+    bool convert(Flag flag, std::string_view text, TypedValue& out) const {
+      return schema.convert_value(flag, text, out);
+    }
+
+    std::string value_name(Flag flag) const {
+      return std::string(schema.value_name(flag));
+    }
+
+    std::string_view missing_required(const ParseView& result) const {
+      for (std::size_t f = 0; f < kFlags; ++f) {
+        if (schema.flags_[f].required && schema.in_scope(f, chain, depth) &&
+            !result.has_flag(schema.canonical(f))) {
+          return schema.canonical(f);
+        }
+      }
+      return {};
+    }
+  };
+
+  /// What a flag's value looks like, e.g. "size" or "none|atomic|fsync"
+  constexpr std::string_view value_name(std::size_t flag) const {
+    return flags_[flag].type == FlagType::Enum && !flags_[flag].choices.empty()
+               ? flags_[flag].choices
+               : flag_type_name(flags_[flag].type);
+  }
+
+  /// Convert the text of a typed flag, including Enum choices
+  bool convert_value(std::size_t flag, std::string_view text,
+                     TypedValue& out) const {
+    if (flags_[flag].type != FlagType::Enum) {
+      return parse_flag_value(flags_[flag].type, text, out);
+    }
+    std::string_view rest = flags_[flag].choices;
+    for (std::size_t index = 0; !rest.empty(); ++index) {
+      std::size_t bar = rest.find('|');
+      if (rest.substr(0, bar) == text) {
+        out = Choice{index};
+        return true;
+      }
+      rest = bar == std::string_view::npos ? std::string_view()
+                                           : rest.substr(bar + 1);
+    }
+    return false;
+  }
+
+  constexpr std::string_view canonical(std::size_t flag) const {
+    return long_[flag].empty() ? short_[flag] : long_[flag];
+  }
+
+  constexpr std::size_t find_command(std::string_view path) const {
+    for (std::size_t i = 0; i < NC; ++i) {
+      if (commands_[i].path == path) {
+        return i;
+      }
+    }
+    return kNone;
+  }
+
+  /// Order for the command table: by parent, then by name
+  constexpr bool command_less(std::size_t a, std::size_t b) const {
+    if (parent_[a] != parent_[b]) {
+      return parent_[a] + 1 < parent_[b] + 1;  // kNone (top level) first
+    }
+    return command_name_[a] < command_name_[b];
+  }
+
+  constexpr void sort_commands() {
+    for (std::size_t i = 0; i < NC; ++i) {
+      order_[i] = i;
+    }
+    // Insertion sort: std::sort is not constexpr before C++20
+    for (std::size_t i = 1; i < NC; ++i) {
+      std::size_t value = order_[i];
+      std::size_t j = i;
+      for (; j > 0 && command_less(value, order_[j - 1]); --j) {
+        order_[j] = order_[j - 1];
+      }
+      order_[j] = value;
+    }
+    for (std::size_t i = 1; i < NC; ++i) {
+      detail::schema_check(command_less(order_[i - 1], order_[i]),
+                           "Duplicate command");
+    }
+  }
+
+  /// Binary search the command table for a child of parent
+  constexpr std::size_t find_child(std::size_t parent,
+                                   std::string_view name) const {
+    std::size_t lo = 0;
+    std::size_t hi = NC;
+    while (lo < hi) {
+      std::size_t mid = lo + (hi - lo) / 2;
+      std::size_t index = order_[mid];
+      bool less = parent_[index] != parent
+                      ? parent_[index] + 1 < parent + 1
+                      : command_name_[index] < name;
+      if (less) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < NC && parent_[order_[lo]] == parent &&
+        command_name_[order_[lo]] == name) {
+      return order_[lo];
+    }
+    return kNone;
+  }
+
+  constexpr void split_names(std::size_t flag) {
+    std::string_view names = flags_[flag].names;
+    std::size_t comma = names.find(',');
+    std::string_view parts[2] = {
+        detail::sv_trim(names.substr(0, comma)),
+        comma == std::string_view::npos
+            ? std::string_view()
+            : detail::sv_trim(names.substr(comma + 1))};
+    for (std::string_view part : parts) {
+      if (part.empty()) {
+        continue;
+      }
+      detail::schema_check(part.size() > 1 && part[0] == '-',
+                           "Flag names must start with '-'");
+      std::string_view& slot =
+          detail::sv_starts_with(part, "--") ? long_[flag] : short_[flag];
+      detail::schema_check(slot.empty(), "Flag has two names of one form");
+      slot = part;
+    }
+    detail::schema_check(!canonical(flag).empty(), "Flag has no name");
+  }
+
+  constexpr void sort_entries() {
+    // Ordered by (name, scope) so that duplicates are always adjacent
+    auto before = [this](const FlagEntry& a, const FlagEntry& b) {
+      return a.name < b.name ||
+             (a.name == b.name && scope_[a.flag] < scope_[b.flag]);
+    };
+    for (std::size_t i = 1; i < entry_count_; ++i) {
+      FlagEntry value = entries_[i];
+      std::size_t j = i;
+      for (; j > 0 && before(value, entries_[j - 1]); --j) {
+        entries_[j] = entries_[j - 1];
+      }
+      entries_[j] = value;
+    }
+    for (std::size_t i = 1; i < entry_count_; ++i) {
+      detail::schema_check(
+          entries_[i - 1].name != entries_[i].name ||
+              scope_[entries_[i - 1].flag] != scope_[entries_[i].flag],
+          "Duplicate flag name");
+    }
+  }
+
+  /// Whether a flag applies to a command chain
+  bool in_scope(std::size_t flag, const std::array<std::size_t, NC + 1>& chain,
+                std::size_t depth) const {
+    return rank(flag, chain, depth) != kNone;
+  }
+
+  /// Priority of a flag for a command chain: the outermost command first,
+  /// then global flags; kNone if the flag does not apply
+  std::size_t rank(std::size_t flag,
+                   const std::array<std::size_t, NC + 1>& chain,
+                   std::size_t depth) const {
+    if (scope_[flag] == kNone) {
+      return depth;
+    }
+    for (std::size_t level = 0; level < depth; ++level) {
+      if (chain[level] == scope_[flag]) {
+        return level;
+      }
+    }
+    return kNone;
+  }
+
+  /// Binary search the name table, then pick the best-ranked match
+  std::size_t find_flag(std::string_view name,
+                        const std::array<std::size_t, NC + 1>& chain,
+                        std::size_t depth) const {
+    std::size_t lo = 0;
+    std::size_t hi = entry_count_;
+    while (lo < hi) {
+      std::size_t mid = lo + (hi - lo) / 2;
+      if (entries_[mid].name < name) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    std::size_t best = kNone;
+    std::size_t best_rank = kNone;
+    for (; lo < entry_count_ && entries_[lo].name == name; ++lo) {
+      std::size_t r = rank(entries_[lo].flag, chain, depth);
+      if (r < best_rank) {
+        best = entries_[lo].flag;
+        best_rank = r;
+      }
+    }
+    return best;
+  }
+
+  template <typename Sink>
+  constexpr void write_flags(std::size_t scope, Sink& sink) const {
+    for (std::size_t i = 0; i < kFlags; ++i) {
+      if (scope_[i] != scope) {
+        continue;
+      }
+      sink.put("  ");
+      if (!short_[i].empty()) {
+        sink.put(short_[i]);
+        if (!long_[i].empty()) {
+          sink.put(", ");
+        }
+      }
+      sink.put(long_[i]);
+      if (flags_[i].type != FlagType::Boolean) {
+        sink.put(" <");
+        sink.put(value_name(i));
+        sink.put('>');
+      }
+      if (!flags_[i].description.empty()) {
+        sink.put('\t');
+        sink.put(flags_[i].description);
+      }
+      if (flags_[i].required) {
+        sink.put(" (required)");
+      }
+      sink.put('\n');
+    }
+  }
+
+  template <typename Sink>
+  constexpr void write_children(std::size_t parent, Sink& sink) const {
+    for (std::size_t i = 0; i < NC; ++i) {
+      std::size_t index = order_[i];
+      if (parent_[index] != parent) {
+        continue;
+      }
+      sink.put("  ");
+      sink.put(command_name_[index]);
+      if (!commands_[index].description.empty()) {
+        sink.put('\t');
+        sink.put(commands_[index].description);
+      }
+      sink.put('\n');
+    }
+    sink.put('\n');
+  }
+
+  constexpr bool has_children(std::size_t parent) const {
+    for (std::size_t i = 0; i < NC; ++i) {
+      if (parent_[i] == parent) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  constexpr bool has_flags(std::size_t scope) const {
+    for (std::size_t i = 0; i < kFlags; ++i) {
+      if (scope_[i] == scope) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <typename Sink>
+  constexpr void write_program_help(Sink& sink) const {
+    sink.put(program_.name);
+    if (!program_.description.empty()) {
+      sink.put(" - ");
+      sink.put(program_.description);
+    }
+    sink.put("\n\nUsage: ");
+    sink.put(program_.name);
+    if (!program_.usage.empty()) {
+      sink.put(' ');
+      sink.put(program_.usage);
+    } else if (NC == 0) {
+      sink.put(" [options] [args...]");
+    } else {
+      sink.put(" <command> [options]");
+    }
+    sink.put("\n\n");
+    if (NC > 0) {
+      sink.put("Commands:\n");
+      write_children(kNone, sink);
+    }
+    sink.put("Options:\n");
+    write_flags(kNone, sink);
+  }
+
+  template <typename Sink>
+  constexpr void write_command_help(std::size_t command, Sink& sink) const {
+    auto put_path = [&]() {
+      sink.put(program_.name);
+      sink.put(' ');
+      for (char c : commands_[command].path) {
+        sink.put(c == '.' ? ' ' : c);
+      }
+    };
+    put_path();
+    if (!commands_[command].description.empty()) {
+      sink.put(" - ");
+      sink.put(commands_[command].description);
+    }
+    sink.put("\n\nUsage: ");
+    put_path();
+    bool children = has_children(command);
+    if (children) {
+      sink.put(" <subcommand>");
+    }
+    sink.put(" [options]\n\n");
+    if (children) {
+      sink.put("Subcommands:\n");
+      write_children(command, sink);
+    }
+    if (has_flags(command)) {
+      sink.put("Command Options:\n");
+      write_flags(command, sink);
+      sink.put('\n');
+    }
+    sink.put("Global Options:\n");
+    write_flags(kNone, sink);
+  }
+
+  ProgramSpec program_;
+  std::array<CommandSpec, NC> commands_{};
+  std::array<std::string_view, NC> command_name_{};  // Last path component
+  std::array<std::size_t, NC> parent_{};             // kNone for top level
+  std::array<std::size_t, NC> order_{};  // Sorted by (parent, name)
+  std::array<FlagSpec, kFlags> flags_{};
+  std::array<std::string_view, kFlags> short_{};
+  std::array<std::string_view, kFlags> long_{};
+  std::array<std::size_t, kFlags> scope_{};  // Command index or kNone
+  std::array<FlagEntry, 2 * kFlags> entries_{};  // Sorted by name
+  std::size_t entry_count_ = 0;
+};
+
+/// Build a schema for a tool with commands
+template <std::size_t NC, std::size_t NF>
+constexpr Schema<NC, NF> make_schema(const ProgramSpec& program,
+                                     const CommandSpec (&commands)[NC],
+                                     const FlagSpec (&flags)[NF]) {
+  return Schema<NC, NF>(program, commands, flags);
+}
+
+/// Build a schema for a command-less tool (flags and positional args)
+template <std::size_t NF>
+constexpr Schema<0, NF> make_schema(const ProgramSpec& program,
+                                    const FlagSpec (&flags)[NF]) {
+  return Schema<0, NF>(program, nullptr, flags);
+}
+
+/// Help text of every page of a schema in one constant buffer
+template <std::size_t Size, std::size_t Pages>
+struct HelpTable {
+  std::array<char, Size> text{};
+  std::array<std::size_t, Pages + 1> offsets{};
+
+  constexpr std::string_view page(std::size_t index) const {
+    return {text.data() + offsets[index], offsets[index + 1] - offsets[index]};
+  }
+};
+
+namespace detail {
+
+template <const auto& S>
+constexpr std::size_t help_size() {
+  HelpCounter counter;
+  for (std::size_t page = 0; page <= S.command_count(); ++page) {
+    S.write_help(page, counter);
+  }
+  return counter.size;
+}
+
+template <const auto& S>
+constexpr auto build_help() {
+  constexpr std::size_t kSize = help_size<S>();
+  HelpTable<kSize, S.command_count() + 1> table{};
+  HelpWriter<kSize> writer{table.text};
+  for (std::size_t page = 0; page <= S.command_count(); ++page) {
+    table.offsets[page] = writer.pos;
+    S.write_help(page, writer);
+  }
+  table.offsets[S.command_count() + 1] = writer.pos;
+  return table;
+}
+
+}  // namespace detail
+
+/// Runner for a constexpr schema; all help text is generated at compile
+/// time. Usage:
+///   static constexpr auto kSchema = cli::make_schema(program, commands,
+///                                                    flags);
+///   int main(int argc, char* argv[]) {
+///     return cli::StaticCli<kSchema>::run(argc, argv);
+///   }
+template <const auto& S>
+class StaticCli {
+ public:
+  /// Parse argv without running anything
+  static ParseView parse(int argc, char* argv[]) { return S.parse(argc, argv); }
+
+  /// Program help text
+  static constexpr std::string_view help() {
+    return kHelp.page(S.command_count());
+  }
+
+  /// Help text of a command (a compile error in constant expressions if
+  /// there is no such command)
+  static constexpr std::string_view help(std::string_view command) {
+    return kHelp.page(S.command(command));
+  }
+
+  /// Parse and dispatch to the handler, with the hidden --serve and
+  /// --profile flags, as CliExecutor::run does
+  static int run(int argc, char* argv[]) {
+    auto start = std::chrono::steady_clock::now();
+    return run_command_line(
+        argc, argv, std::string(S.program().name), start,
+        [](std::string_view name) { return S.has_global_flag(name); },
+        &run_args);
+  }
+
+ private:
+  static constexpr auto kHelp = detail::build_help<S>();
+
+  /// Parse and execute one command line (a CommandLineRunner)
+  static int run_args(const std::vector<std::string_view>& args,
+                      Profiler* profiler) {
+    std::size_t command = S.kNone;
+    ParseView view = S.parse(args, &command);
+    if (profiler) {
+      profiler->end_phase("parse");
+    }
+    if (!view.success) {
+      std::fprintf(stderr, "Error: %s\n", view.error_message.c_str());
+      std::fprintf(stderr, "Use --help for usage information.\n");
+      return -1;
+    }
+    std::string_view page =
+        kHelp.page(command == S.kNone ? S.command_count() : command);
+    if (view.get_bool("--help")) {
+      std::fwrite(page.data(), 1, page.size(), stdout);
+      return 0;
+    }
+    ViewHandler handler = S.handler(command);
+    if (!handler) {
+      if (command == S.kNone) {
+        return -1;
+      }
+      // Command exists but has no handler - show help for this level
+      std::fwrite(page.data(), 1, page.size(), stdout);
+      return 0;
+    }
+    int code = handler(view);
+    if (profiler) {
+      profiler->end_phase("execute");
+    }
+    return code;
+  }
+};
+
+}  // namespace cli
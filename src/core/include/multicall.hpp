@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/// Entry point of a tool: what its main() would do
+using ToolMain = int (*)(int argc, char* argv[]);
+
+/// Register a tool with the multi-call binary
+/// @return true, so registration can initialize a static
+bool register_tool(const char* name, ToolMain entry);
+
+/// Names of the registered tools, sorted
+std::vector<std::string> registered_tools();
+
+/// main() of the multi-call binary: runs the tool named by the basename of
+/// argv[0] (when invoked through a symlink such as `tail -> cpp-cli`), or
+/// else by argv[1] with the remaining arguments (`cpp-cli tail show`)
+/// @return The tool's exit code, or 1 if no registered tool is named
+int multicall_main(int argc, char* argv[]);
+
+}  // namespace cli
+
+/// Define a tool's entry point. A standalone build gets a main() that
+/// calls it; a build for the multi-call binary (CLI_MULTICALL defined)
+/// registers it under name instead.
+#ifdef CLI_MULTICALL
+#define CLI_TOOL_MAIN(name, entry) \
+  static const bool cli_tool_registered_ = ::cli::register_tool(name, entry);
+#else
+#define CLI_TOOL_MAIN(name, entry) \
+  int main(int argc, char* argv[]) { return entry(argc, argv); }
+#endif
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cli.hpp"
+#include "trace.hpp"
+
+namespace cli {
+
+namespace detail {
+
+constexpr bool sv_starts_with(std::string_view str, std::string_view prefix) {
+  return str.size() >= prefix.size() &&
+         str.compare(0, prefix.size(), prefix) == 0;
+}
+
+/// Record a flag, replacing the values of an earlier occurrence
+inline void set_parsed_flag(ParseView& result, std::string_view name,
+                            FlagType type, std::uint32_t first,
+                            TypedValue value) {
+  auto count = static_cast<std::uint32_t>(result.values.size()) - first;
+  for (auto& flag : result.flags) {
+    if (flag.name == name) {
+      flag.first = first;
+      flag.count = count;
+      flag.value = value;
+      return;
+    }
+  }
+  result.flags.push_back({name, type, first, count, value});
+}
+
+}  // namespace detail
+
+/// Parse arguments (without the program name) with a front end's grammar:
+/// expand response files, take the leading commands, then flags and
+/// positionals, then check required flags. CliExecutor and Schema both
+/// parse through here, so they accept the same syntax and report the same
+/// errors. A Grammar serves one parse and provides:
+///
+///   using Flag = ...;  // The front end's handle for a declared flag
+///   static constexpr const char* kTraceName;  // Span name of the parse
+///   // Take the commands at the start of args (which may be empty),
+///   // advancing i; false with result's error set if that fails
+///   bool parse_commands(const std::vector<std::string_view>& args,
+///                       std::size_t& i, ParseView& result);
+///   // Find a flag of the commands taken, or a global flag
+///   bool find_flag(std::string_view name, Flag& flag) const;
+///   std::string_view canonical(Flag flag) const;
+///   FlagType type(Flag flag) const;
+///   // Convert the text of a typed flag, including Enum choices
+///   bool convert(Flag flag, std::string_view text, TypedValue& out) const;
+///   // What the flag's value looks like, e.g. "size" or "fast|safe"
+///   std::string value_name(Flag flag) const;
+///   // Canonical name of a required flag in scope that result lacks, or
+///   // empty if there is none
+///   std::string_view missing_required(const ParseView& result) const;
+template <typename Grammar>
+ParseView parse_arguments(const std::vector<std::string_view>& raw_args,
+                          Grammar& grammar) {
+  CLI_TRACE_SPAN(Grammar::kTraceName);
+  ParseView result;
+  result.success = true;
+
+  std::vector<std::string_view> expanded;
+  const auto* expanded_args = expand_response_files(raw_args, expanded, result);
+  if (!expanded_args) {
+    return result;
+  }
+  const auto& args = *expanded_args;
+
+  std::size_t i = 0;
+  if (!grammar.parse_commands(args, i, result) || args.empty()) {
+    return result;
+  }
+
+  // Values and positionals are views into args: at most one allocation
+  // each, however many arguments there are
+  result.positional_args.reserve(args.size() - i);
+  result.values.reserve(args.size() - i);
+
+  for (; i < args.size(); ++i) {
+    std::string_view arg = args[i];
+    if (!detail::sv_starts_with(arg, "-") || arg.size() == 1) {
+      result.positional_args.push_back(arg);
+      continue;
+    }
+    // --flag=value or --flag=val1,val2
+    std::string_view name = arg;
+    std::string_view inline_value;
+    bool has_inline = false;
+    if (detail::sv_starts_with(arg, "--")) {
+      std::size_t eq = arg.find('=');
+      if (eq != std::string_view::npos) {
+        name = arg.substr(0, eq);
+        inline_value = arg.substr(eq + 1);
+        has_inline = true;
+      }
+    }
+    typename Grammar::Flag flag{};
+    if (!grammar.find_flag(name, flag)) {
+      result.success = false;
+      result.error_message = "Unknown flag: " + std::string(name);
+      return result;
+    }
+
+    auto first = static_cast<std::uint32_t>(result.values.size());
+    TypedValue value;
+    FlagType type = grammar.type(flag);
+    if (type != FlagType::Boolean && type != FlagType::MultiArg) {
+      // One value: the inline text, else the next argument even if it
+      // starts with '-' (e.g. -5)
+      if (!has_inline && i + 1 >= args.size()) {
+        result.success = false;
+        result.error_message =
+            "Missing value for flag: " + std::string(grammar.canonical(flag));
+        return result;
+      }
+      std::string_view text = has_inline ? inline_value : args[++i];
+      if (!grammar.convert(flag, text, value)) {
+        result.success = false;
+        result.error_message = "Invalid value for " +
+                               std::string(grammar.canonical(flag)) + ": '" +
+                               std::string(text) + "' (expected " +
+                               grammar.value_name(flag) + ")";
+        return result;
+      }
+    } else if (type == FlagType::MultiArg) {
+      if (!inline_value.empty()) {
+        // Split comma-separated values
+        while (!inline_value.empty()) {
+          std::size_t comma = inline_value.find(',');
+          std::string_view item = inline_value.substr(0, comma);
+          if (!item.empty()) {
+            result.values.push_back(item);
+          }
+          inline_value = comma == std::string_view::npos
+                             ? std::string_view()
+                             : inline_value.substr(comma + 1);
+        }
+      } else {
+        // Collect following non-flag arguments
+        while (i + 1 < args.size() &&
+               !detail::sv_starts_with(args[i + 1], "-")) {
+          result.values.push_back(args[++i]);
+        }
+      }
+    }
+    detail::set_parsed_flag(result, grammar.canonical(flag), type, first,
+                            value);
+  }
+
+  std::string_view missing = grammar.missing_required(result);
+  if (!missing.empty()) {
+    result.success = false;
+    result.error_message = "Missing required flag: " + std::string(missing);
+  }
+  return result;
+}
+
+}  // namespace cli
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+/// Measurements behind the hidden --profile flag of CliExecutor::run: wall
+/// time per phase, hardware counters per phase where perf_event_open is
+/// permitted, and getrusage totals for the process
+class Profiler {
+ public:
+  /// One finished phase
+  struct Phase {
+    std::string name;
+    std::chrono::nanoseconds wall{};
+    bool has_counters = false;
+    std::uint64_t cycles = 0;
+    std::uint64_t instructions = 0;
+    std::uint64_t cache_misses = 0;
+  };
+
+  /// Start measuring; the time since start counts as the "register" phase
+  /// (building the executor), which has no counters
+  explicit Profiler(std::chrono::steady_clock::time_point start);
+  ~Profiler();
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  /// End the current phase and begin the next one
+  void end_phase(const char* name);
+
+  const std::vector<Phase>& phases() const { return phases_; }
+
+  /// Write the report to stderr, or as JSON to json_path if it is not empty
+  /// @return false if the JSON file cannot be written
+  bool report(const std::string& program, const std::string& json_path) const;
+
+ private:
+  bool read_counters(std::uint64_t (&values)[3]) const;
+
+  std::chrono::steady_clock::time_point phase_start_;
+  int counter_fds_[3] = {-1, -1, -1};  // Group leader first
+  std::uint64_t counters_start_[3] = {};
+  std::vector<Phase> phases_;
+};
+
+}  // namespace cli
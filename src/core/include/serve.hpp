@@ -0,0 +1,71 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cli {
+
+/// How command lines and results are framed in --serve mode
+///
+/// LengthPrefixed (Unix socket): a request is a u32 argument count followed
+/// by each argument as a u32 byte length and its bytes; a response is an
+/// i32 exit code followed by the captured stdout and stderr, each as a u32
+/// length and its bytes. Integers are in host byte order, since both ends
+/// run on the same machine.
+///
+/// Lines (stdin): a request is one line with arguments separated by tabs;
+/// a response is a header line "<exit code> <stdout bytes> <stderr bytes>"
+/// followed by the captured stdout and stderr.
+enum class ServeFraming {
+  LengthPrefixed,
+  Lines
+};
+
+/// Output of one command line run by a server
+struct ServeResponse {
+  int exit_code = 0;
+  std::string out;  // Captured stdout
+  std::string err;  // Captured stderr
+};
+
+/// Runs one command line (arguments without the program name) and returns
+/// its exit code
+using CommandLineHandler =
+    std::function<int(const std::vector<std::string_view>&)>;
+
+/// Run command lines with run, each with stdout and stderr captured, until
+/// in_fd ends or a response cannot be written (see CliExecutor::serve)
+int serve_stream(int in_fd, int out_fd, ServeFraming framing,
+                 const CommandLineHandler& run);
+
+/// Serve command lines with run on a Unix socket, or on stdin and stdout
+/// for "-" (see CliExecutor::serve)
+int serve(const std::string& endpoint, const CommandLineHandler& run);
+
+/// Write a length-prefixed request
+bool write_request(int fd, const std::vector<std::string>& args);
+
+/// Read a length-prefixed request
+/// @return false at end of input or on a malformed request
+bool read_request(int fd, std::vector<std::string>& args);
+
+/// Write a length-prefixed response
+bool write_response(int fd, const ServeResponse& response);
+
+/// Read a length-prefixed response
+bool read_response(int fd, ServeResponse& response);
+
+/// Connect to a server listening on a Unix socket
+/// @return The connected descriptor, or -1 with errno set
+int connect_server(const std::string& socket_path);
+
+/// Run a command line on a server and replay its stdout, stderr and exit
+/// code in this process (the client side of --serve)
+/// @param args Arguments, without the program name
+/// @return The command's exit code, or -1 if the server cannot be reached
+int forward_command(const std::string& socket_path,
+                    const std::vector<std::string>& args);
+
+}  // namespace cli
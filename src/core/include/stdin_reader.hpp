@@ -15,6 +15,8 @@
 #include <unistd.h>
 #endif
 
+#include "trace.hpp"
+
 namespace cli {
 
 /// Utility class for reading from stdin
@@ -27,6 +29,7 @@ public:
     
     /// Read all content from stdin as a single string
     static std::string read_all() {
+        CLI_TRACE_SPAN("StdinReader::read_all");
         std::string content;
         std::string line;
         while (std::getline(std::cin, line)) {
@@ -41,6 +44,7 @@ public:
     
     /// Read all lines from stdin into a vector
     static std::vector<std::string> read_lines() {
+        CLI_TRACE_SPAN("StdinReader::read_lines");
         std::vector<std::string> lines;
         std::string line;
         while (std::getline(std::cin, line)) {
@@ -51,6 +55,7 @@ public:
     
     /// Read last N lines from stdin (memory efficient for large inputs)
     static std::vector<std::string> read_last_n_lines(std::size_t n) {
+        CLI_TRACE_SPAN("StdinReader::read_last_n_lines");
         if (n == 0) return {};
         
         std::deque<std::string> buffer;
@@ -68,6 +73,7 @@ public:
     
     /// Read first N lines from stdin
     static std::vector<std::string> read_first_n_lines(std::size_t n) {
+        CLI_TRACE_SPAN("StdinReader::read_first_n_lines");
         std::vector<std::string> lines;
         lines.reserve(n);
         std::string line;
@@ -84,6 +90,7 @@ public:
     /// Otherwise reads from stdin
     static std::optional<std::vector<std::string>> read_lines_from(
             const std::string& source) {
+        CLI_TRACE_SPAN("StdinReader::read_lines_from");
         if (source.empty() || source == "-") {
             return read_lines();
         }
@@ -101,6 +108,33 @@ public:
         }
         return lines;
     }
+    
+    /// Stream lines from stdin or a file without holding them in memory
+    /// If filename is provided and not "-", reads from file
+    /// Otherwise reads from stdin
+    /// @param fn Called with each line; return false to stop early
+    /// @return false if the file could not be opened
+    template <typename Fn>
+    static bool for_each_line_from(const std::string& source, Fn&& fn) {
+        CLI_TRACE_SPAN("StdinReader::for_each_line_from");
+        std::ifstream file;
+        if (!source.empty() && source != "-") {
+            file.open(source);
+            if (!file) {
+                return false;
+            }
+        }
+        std::istream& in = file.is_open() ? static_cast<std::istream&>(file)
+                                          : std::cin;
+        
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!fn(line)) {
+                break;
+            }
+        }
+        return true;
+    }
 };
 
 } // namespace cli
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace cli {
+namespace trace {
+
+namespace detail {
+// Bumped by start() and stop(): odd while tracing is on, and different for
+// every tracing session
+extern std::atomic<std::uint64_t> generation;
+std::uint64_t now_ns();
+// Dropped unless tracing is still in the session the span began in
+void record(const char* name, std::uint64_t generation, std::uint64_t start_ns,
+            std::uint64_t end_ns);
+}  // namespace detail
+
+/// Whether spans are being recorded
+inline bool enabled() {
+  return (detail::generation.load(std::memory_order_relaxed) & 1) != 0;
+}
+
+/// Start recording spans, to be written to path as Chrome trace-event JSON
+/// (viewable in Perfetto or chrome://tracing) by stop() or at exit.
+/// Tracing also starts at startup when CLI_TRACE names a file.
+/// @return false if tracing is already on
+bool start(const std::string& path);
+
+/// Stop recording and write the trace. Spans still open are dropped when
+/// they end. Other threads must not be ending spans while this runs; each
+/// thread appends to its own buffer without locking.
+/// @return false if tracing was off or the file cannot be written
+bool stop();
+
+/// Records the time from construction to destruction as one span. Whether
+/// tracing is on is read once, at construction; while it is off, the only
+/// cost is one load and the same branch on it in the constructor and the
+/// destructor. A span still open when stop() runs is dropped.
+class Span {
+ public:
+  explicit Span(const char* name)
+      : name_(name),
+        generation_(detail::generation.load(std::memory_order_relaxed)) {
+    if (generation_ & 1) {
+      start_ns_ = detail::now_ns();
+    }
+  }
+
+  ~Span() {
+    if (generation_ & 1) {
+      detail::record(name_, generation_, start_ns_, detail::now_ns());
+    }
+  }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+ private:
+  const char* name_;
+  std::uint64_t generation_;  // Session the span began in; odd if tracing
+  std::uint64_t start_ns_ = 0;
+};
+
+}  // namespace trace
+}  // namespace cli
+
+#define CLI_TRACE_CONCAT_(a, b) a##b
+#define CLI_TRACE_CONCAT(a, b) CLI_TRACE_CONCAT_(a, b)
+
+/// Trace the rest of the enclosing scope as a span. name must outlive the
+/// trace (e.g., a string literal).
+#define CLI_TRACE_SPAN(name) \
+  ::cli::trace::Span CLI_TRACE_CONCAT(cli_trace_span_, __LINE__)(name)
@@ -0,0 +1,73 @@
+#include "multicall.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+namespace cli {
+
+namespace {
+// Function-local so tools can register from static initializers in any order
+std::vector<std::pair<std::string_view, ToolMain>>& tools() {
+    static std::vector<std::pair<std::string_view, ToolMain>> registry;
+    return registry;
+}
+
+ToolMain find_tool(std::string_view name) {
+    for (const auto& [tool, entry] : tools()) {
+        if (tool == name) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
+bool register_tool(const char* name, ToolMain entry) {
+    tools().emplace_back(name, entry);
+    return true;
+}
+
+std::vector<std::string> registered_tools() {
+    std::vector<std::string> names;
+    for (const auto& tool : tools()) {
+        names.emplace_back(tool.first);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+int multicall_main(int argc, char* argv[]) {
+    std::string_view invoked = argc > 0 ? argv[0] : "";
+    size_t slash = invoked.rfind('/');
+    if (slash != std::string_view::npos) {
+        invoked.remove_prefix(slash + 1);
+    }
+    if (ToolMain entry = find_tool(invoked)) {
+        return entry(argc, argv);
+    }
+
+    // `cpp-cli <tool> args...`: the tool sees its own name as argv[0]
+    if (argc > 1) {
+        if (ToolMain entry = find_tool(argv[1])) {
+            return entry(argc - 1, argv + 1);
+        }
+    }
+
+    bool help = argc > 1 && (std::strcmp(argv[1], "--help") == 0 ||
+                             std::strcmp(argv[1], "-h") == 0);
+    if (argc > 1 && !help) {
+        std::fprintf(stderr, "Error: Unknown tool: %s\n", argv[1]);
+    }
+    std::FILE* out = help ? stdout : stderr;
+    std::fprintf(out, "Usage: %.*s <tool> [args...]\n\nTools:\n",
+                 static_cast<int>(invoked.size()), invoked.data());
+    for (const auto& name : registered_tools()) {
+        std::fprintf(out, "  %s\n", name.c_str());
+    }
+    return help ? 0 : 1;
+}
+
+} // namespace cli
@@ -0,0 +1,160 @@
+#include "profile.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace cli {
+
+namespace {
+constexpr const char* kCounterNames[3] = {"cycles", "instructions", "cache_misses"};
+constexpr std::uint64_t kCounterConfigs[3] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+
+// Count in user space for this process, so it works under the default
+// perf_event_paranoid setting
+int open_counter(std::uint64_t config, int group_fd) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd < 0 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return static_cast<int>(
+        ::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+double to_ms(std::chrono::nanoseconds time) {
+    return std::chrono::duration<double, std::milli>(time).count();
+}
+
+double to_ms(const timeval& time) {
+    return static_cast<double>(time.tv_sec) * 1e3 + static_cast<double>(time.tv_usec) / 1e3;
+}
+} // namespace
+
+Profiler::Profiler(std::chrono::steady_clock::time_point start) : phase_start_(start) {
+    end_phase("register");
+
+    // All three counters or none: a partial group would mix up the report
+    for (int i = 0; i < 3; ++i) {
+        counter_fds_[i] = open_counter(kCounterConfigs[i], i == 0 ? -1 : counter_fds_[0]);
+        if (counter_fds_[i] < 0) {
+            for (int& fd : counter_fds_) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fd = -1;
+            }
+            break;
+        }
+    }
+    if (counter_fds_[0] >= 0) {
+        ::ioctl(counter_fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        read_counters(counters_start_);
+    }
+    phase_start_ = std::chrono::steady_clock::now();
+}
+
+Profiler::~Profiler() {
+    for (int fd : counter_fds_) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+bool Profiler::read_counters(std::uint64_t (&values)[3]) const {
+    if (counter_fds_[0] < 0) {
+        return false;
+    }
+    std::uint64_t group[4] = {};  // Count of events, then their values
+    if (::read(counter_fds_[0], group, sizeof(group)) != sizeof(group) || group[0] != 3) {
+        return false;
+    }
+    std::memcpy(values, group + 1, sizeof(values));
+    return true;
+}
+
+void Profiler::end_phase(const char* name) {
+    Phase phase;
+    phase.name = name;
+    std::uint64_t now[3];
+    if (!phases_.empty() && read_counters(now)) {
+        phase.has_counters = true;
+        phase.cycles = now[0] - counters_start_[0];
+        phase.instructions = now[1] - counters_start_[1];
+        phase.cache_misses = now[2] - counters_start_[2];
+        std::memcpy(counters_start_, now, sizeof(now));
+    }
+    auto end = std::chrono::steady_clock::now();
+    phase.wall = end - phase_start_;
+    phases_.push_back(std::move(phase));
+    phase_start_ = end;
+}
+
+bool Profiler::report(const std::string& program, const std::string& json_path) const {
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+
+    if (json_path.empty()) {
+        for (const auto& phase : phases_) {
+            std::fprintf(stderr, "profile: %-8s %10.3f ms", phase.name.c_str(), to_ms(phase.wall));
+            if (phase.has_counters) {
+                std::fprintf(stderr, "  cycles %llu  instructions %llu  cache_misses %llu",
+                             static_cast<unsigned long long>(phase.cycles),
+                             static_cast<unsigned long long>(phase.instructions),
+                             static_cast<unsigned long long>(phase.cache_misses));
+            }
+            std::fprintf(stderr, "\n");
+        }
+        if (counter_fds_[0] < 0) {
+            std::fprintf(stderr, "profile: hardware counters unavailable\n");
+        }
+        std::fprintf(stderr,
+                     "profile: max_rss %ld KiB  minor_faults %ld  major_faults %ld  "
+                     "voluntary_switches %ld  involuntary_switches %ld  "
+                     "user %.3f ms  system %.3f ms\n",
+                     usage.ru_maxrss, usage.ru_minflt, usage.ru_majflt, usage.ru_nvcsw,
+                     usage.ru_nivcsw, to_ms(usage.ru_utime), to_ms(usage.ru_stime));
+        return true;
+    }
+
+    std::FILE* out = std::fopen(json_path.c_str(), "w");
+    if (!out) {
+        std::fprintf(stderr, "Error: Cannot write profile to %s: %s\n", json_path.c_str(),
+                     std::strerror(errno));
+        return false;
+    }
+    std::fprintf(out, "{\"program\": \"%s\", \"phases\": [", program.c_str());
+    for (size_t i = 0; i < phases_.size(); ++i) {
+        const auto& phase = phases_[i];
+        std::fprintf(out, "%s\n  {\"name\": \"%s\", \"wall_ns\": %lld", i ? "," : "",
+                     phase.name.c_str(), static_cast<long long>(phase.wall.count()));
+        if (phase.has_counters) {
+            const std::uint64_t values[3] = {phase.cycles, phase.instructions,
+                                             phase.cache_misses};
+            for (int c = 0; c < 3; ++c) {
+                std::fprintf(out, ", \"%s\": %llu", kCounterNames[c],
+                             static_cast<unsigned long long>(values[c]));
+            }
+        }
+        std::fprintf(out, "}");
+    }
+    std::fprintf(out,
+                 "\n], \"rusage\": {\"max_rss_kib\": %ld, \"minor_faults\": %ld, "
+                 "\"major_faults\": %ld, \"voluntary_switches\": %ld, "
+                 "\"involuntary_switches\": %ld, \"user_ms\": %.3f, \"system_ms\": %.3f}}\n",
+                 usage.ru_maxrss, usage.ru_minflt, usage.ru_majflt, usage.ru_nvcsw,
+                 usage.ru_nivcsw, to_ms(usage.ru_utime), to_ms(usage.ru_stime));
+    return std::fclose(out) == 0;
+}
+
+} // namespace cli
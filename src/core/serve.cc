@@ -0,0 +1,402 @@
+#include "serve.hpp"
+
+#include "cli.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace cli {
+
+namespace {
+// Largest request or response field accepted from the other side
+constexpr std::uint32_t kMaxFieldSize = 1u << 30;
+
+bool write_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool write_field(int fd, const std::string& field) {
+    auto size = static_cast<std::uint32_t>(field.size());
+    return write_all(fd, &size, sizeof(size)) && write_all(fd, field.data(), field.size());
+}
+
+bool read_field(int fd, std::string& field) {
+    std::uint32_t size = 0;
+    if (!read_all(fd, &size, sizeof(size)) || size > kMaxFieldSize) {
+        return false;
+    }
+    field.resize(size);
+    return read_all(fd, field.data(), size);
+}
+
+// Reads tab-separated requests, one per line, keeping bytes past the line
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd_(fd) {}
+
+    bool read_request(std::vector<std::string>& args) {
+        size_t end;
+        while ((end = buffer_.find('\n')) == std::string::npos) {
+            char chunk[4096];
+            ssize_t n = ::read(fd_, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                // A last line without a newline is still a request
+                if (buffer_.empty()) {
+                    return false;
+                }
+                buffer_ += '\n';
+                break;
+            }
+            buffer_.append(chunk, static_cast<size_t>(n));
+        }
+        end = buffer_.find('\n');
+        args.clear();
+        if (end > 0) {
+            size_t start = 0;
+            for (;;) {
+                size_t tab = buffer_.find('\t', start);
+                if (tab == std::string::npos || tab > end) {
+                    args.push_back(buffer_.substr(start, end - start));
+                    break;
+                }
+                args.push_back(buffer_.substr(start, tab - start));
+                start = tab + 1;
+            }
+        }
+        buffer_.erase(0, end + 1);
+        return true;
+    }
+
+private:
+    int fd_;
+    std::string buffer_;
+};
+
+bool write_line_response(int fd, const ServeResponse& response) {
+    char header[64];
+    int n = std::snprintf(header, sizeof(header), "%d %zu %zu\n", response.exit_code,
+                          response.out.size(), response.err.size());
+    return write_all(fd, header, static_cast<size_t>(n)) &&
+           write_all(fd, response.out.data(), response.out.size()) &&
+           write_all(fd, response.err.data(), response.err.size());
+}
+
+// Points stdout and stderr at in-memory files while a request runs, and
+// stdin at /dev/null so a command cannot consume the request stream
+class OutputCapture {
+public:
+    OutputCapture()
+        : out_(::memfd_create("serve-stdout", MFD_CLOEXEC)),
+          err_(::memfd_create("serve-stderr", MFD_CLOEXEC)),
+          null_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+          saved_in_(::fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0)),
+          saved_out_(::fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0)),
+          saved_err_(::fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0)) {}
+
+    ~OutputCapture() {
+        for (int fd : {out_, err_, null_, saved_in_, saved_out_, saved_err_}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    bool valid() const { return out_ >= 0 && err_ >= 0 && null_ >= 0; }
+
+    void begin() {
+        std::fflush(nullptr);
+        for (int fd : {out_, err_}) {
+            (void)::ftruncate(fd, 0);
+            ::lseek(fd, 0, SEEK_SET);
+        }
+        ::dup2(null_, STDIN_FILENO);
+        ::dup2(out_, STDOUT_FILENO);
+        ::dup2(err_, STDERR_FILENO);
+        std::clearerr(stdin);
+    }
+
+    void end(ServeResponse& response) {
+        std::fflush(nullptr);
+        restore(saved_in_, STDIN_FILENO);
+        restore(saved_out_, STDOUT_FILENO);
+        restore(saved_err_, STDERR_FILENO);
+        std::clearerr(stdin);
+        contents(out_, response.out);
+        contents(err_, response.err);
+    }
+
+private:
+    static void restore(int saved, int target) {
+        if (saved >= 0) {
+            ::dup2(saved, target);
+        } else {
+            ::close(target);
+        }
+    }
+
+    static void contents(int fd, std::string& text) {
+        struct stat st;
+        text.clear();
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+            return;
+        }
+        text.resize(static_cast<size_t>(st.st_size));
+        ssize_t n = ::pread(fd, text.data(), text.size(), 0);
+        text.resize(n > 0 ? static_cast<size_t>(n) : 0);
+    }
+
+    int out_;
+    int err_;
+    int null_;
+    int saved_in_;
+    int saved_out_;
+    int saved_err_;
+};
+} // namespace
+
+bool write_request(int fd, const std::vector<std::string>& args) {
+    auto count = static_cast<std::uint32_t>(args.size());
+    if (!write_all(fd, &count, sizeof(count))) {
+        return false;
+    }
+    for (const auto& arg : args) {
+        if (!write_field(fd, arg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool read_request(int fd, std::vector<std::string>& args) {
+    std::uint32_t count = 0;
+    if (!read_all(fd, &count, sizeof(count)) || count > kMaxFieldSize / sizeof(count)) {
+        return false;
+    }
+    args.assign(count, std::string());
+    for (auto& arg : args) {
+        if (!read_field(fd, arg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool write_response(int fd, const ServeResponse& response) {
+    auto code = static_cast<std::int32_t>(response.exit_code);
+    return write_all(fd, &code, sizeof(code)) && write_field(fd, response.out) &&
+           write_field(fd, response.err);
+}
+
+bool read_response(int fd, ServeResponse& response) {
+    std::int32_t code = 0;
+    if (!read_all(fd, &code, sizeof(code))) {
+        return false;
+    }
+    response.exit_code = code;
+    return read_field(fd, response.out) && read_field(fd, response.err);
+}
+
+int connect_server(const std::string& socket_path) {
+    sockaddr_un addr{};
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        int saved = errno;
+        ::close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int forward_command(const std::string& socket_path, const std::vector<std::string>& args) {
+    int fd = connect_server(socket_path);
+    if (fd < 0) {
+        std::fprintf(stderr, "Error: Cannot connect to %s: %s\n", socket_path.c_str(),
+                     std::strerror(errno));
+        return -1;
+    }
+    ServeResponse response;
+    bool ok = write_request(fd, args) && read_response(fd, response);
+    ::close(fd);
+    if (!ok) {
+        std::fprintf(stderr, "Error: Server at %s closed the connection\n",
+                     socket_path.c_str());
+        return -1;
+    }
+    write_all(STDOUT_FILENO, response.out.data(), response.out.size());
+    write_all(STDERR_FILENO, response.err.data(), response.err.size());
+    return response.exit_code;
+}
+
+int serve_stream(int in_fd, int out_fd, ServeFraming framing,
+                 const CommandLineHandler& run) {
+    OutputCapture capture;
+    if (!capture.valid()) {
+        std::fprintf(stderr, "Error: Cannot capture output: %s\n", std::strerror(errno));
+        return -1;
+    }
+
+    LineReader lines(in_fd);
+    std::vector<std::string> args;
+    std::vector<std::string_view> views;
+    ServeResponse response;
+    for (;;) {
+        bool more = framing == ServeFraming::Lines ? lines.read_request(args)
+                                                   : read_request(in_fd, args);
+        if (!more) {
+            return 0;
+        }
+        views.assign(args.begin(), args.end());
+        capture.begin();
+        response.exit_code = run(views);
+        capture.end(response);
+
+        bool sent = framing == ServeFraming::Lines ? write_line_response(out_fd, response)
+                                                   : write_response(out_fd, response);
+        if (!sent) {
+            return 0;
+        }
+    }
+}
+
+int serve(const std::string& endpoint, const CommandLineHandler& run) {
+    // A client that disconnects early must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (endpoint == "-") {
+        int in_fd = ::fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+        int out_fd = ::fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        int code = serve_stream(in_fd, out_fd, ServeFraming::Lines, run);
+        ::close(in_fd);
+        ::close(out_fd);
+        return code;
+    }
+
+    sockaddr_un addr{};
+    if (endpoint.size() >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "Error: Socket path too long: %s\n", endpoint.c_str());
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, endpoint.c_str(), endpoint.size() + 1);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener >= 0) {
+        // Only a socket left behind by a server that is gone may be replaced
+        struct stat st;
+        if (::lstat(endpoint.c_str(), &st) == 0) {
+            const char* reason = nullptr;
+            int live = -1;
+            if (!S_ISSOCK(st.st_mode)) {
+                reason = "path exists";
+            } else if ((live = connect_server(endpoint)) >= 0) {
+                ::close(live);
+                reason = "address in use";
+            } else if (errno != ECONNREFUSED) {
+                reason = std::strerror(errno);
+            }
+            if (reason) {
+                std::fprintf(stderr, "Error: Cannot listen on %s: %s\n", endpoint.c_str(),
+                             reason);
+                ::close(listener);
+                return -1;
+            }
+            ::unlink(endpoint.c_str());
+        }
+    }
+    // Only the owner may connect
+    bool bound = false;
+    if (listener >= 0) {
+        mode_t saved_mask = ::umask(0177);
+        bound = ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        ::umask(saved_mask);
+    }
+    if (!bound || ::listen(listener, SOMAXCONN) != 0) {
+        std::fprintf(stderr, "Error: Cannot listen on %s: %s\n", endpoint.c_str(),
+                     std::strerror(errno));
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return -1;
+    }
+
+    for (;;) {
+        int conn = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::fprintf(stderr, "Error: Cannot accept on %s: %s\n", endpoint.c_str(),
+                         std::strerror(errno));
+            ::close(listener);
+            return -1;
+        }
+        serve_stream(conn, conn, ServeFraming::LengthPrefixed, run);
+        ::close(conn);
+    }
+}
+
+int CliExecutor::serve_stream(int in_fd, int out_fd, ServeFraming framing) const {
+    return cli::serve_stream(in_fd, out_fd, framing,
+                             [this](const std::vector<std::string_view>& args) {
+                                 return run_args(args);
+                             });
+}
+
+int CliExecutor::serve(const std::string& endpoint) const {
+    return cli::serve(endpoint, [this](const std::vector<std::string_view>& args) {
+        return run_args(args);
+    });
+}
+
+} // namespace cli
@@ -0,0 +1,162 @@
+#include "trace.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace cli {
+namespace trace {
+
+namespace detail {
+std::atomic<std::uint64_t> generation{0};
+
+std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+} // namespace detail
+
+namespace {
+struct Event {
+    const char* name;
+    std::uint64_t start_ns;
+    std::uint64_t end_ns;
+};
+
+// Written only by its thread; kept after the thread exits so its spans
+// are still in the trace
+struct ThreadBuffer {
+    long tid = 0;
+    std::deque<Event> events;  // Grows without moving recorded events
+};
+
+struct State {
+    std::mutex mutex;  // Guards buffers (registration, not recording) and path
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::string path;
+    std::uint64_t origin_ns = 0;
+    bool exit_hook = false;
+};
+
+// Never destroyed, so threads and the exit hook can use it at any time
+State& state() {
+    static State* instance = new State();
+    return *instance;
+}
+
+thread_local ThreadBuffer* local_buffer = nullptr;
+
+ThreadBuffer& thread_buffer() {
+    if (!local_buffer) {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->tid = static_cast<long>(::syscall(SYS_gettid));
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        local_buffer = buffer.get();
+        s.buffers.push_back(std::move(buffer));
+    }
+    return *local_buffer;
+}
+
+void write_name(std::FILE* out, const char* name) {
+    for (const char* p = name; *p; ++p) {
+        auto c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\') {
+            std::fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            std::fprintf(out, "\\u%04x", c);
+        } else {
+            std::fputc(c, out);
+        }
+    }
+}
+
+void stop_at_exit() {
+    if (enabled()) {
+        stop();
+    }
+}
+
+// CLI_TRACE=trace.json traces any tool without changing it
+struct EnvironmentStart {
+    EnvironmentStart() {
+        const char* path = std::getenv("CLI_TRACE");
+        if (path && *path) {
+            start(path);
+        }
+    }
+} environment_start;
+} // namespace
+
+void detail::record(const char* name, std::uint64_t generation, std::uint64_t start_ns,
+                    std::uint64_t end_ns) {
+    // Its session was flushed by stop() while the span was open
+    if (generation != detail::generation.load(std::memory_order_relaxed)) {
+        return;
+    }
+    thread_buffer().events.push_back({name, start_ns, end_ns});
+}
+
+bool start(const std::string& path) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (enabled()) {
+        return false;
+    }
+    s.path = path;
+    s.origin_ns = detail::now_ns();
+    if (!s.exit_hook) {
+        s.exit_hook = std::atexit(stop_at_exit) == 0;
+    }
+    detail::generation.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool stop() {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (!enabled()) {
+        return false;
+    }
+    // Spans still open belong to this session and are dropped when they end
+    detail::generation.fetch_add(1, std::memory_order_relaxed);
+
+    std::FILE* out = std::fopen(s.path.c_str(), "w");
+    if (!out) {
+        std::fprintf(stderr, "Error: Cannot write trace to %s: %s\n", s.path.c_str(),
+                     std::strerror(errno));
+        return false;
+    }
+    long pid = static_cast<long>(::getpid());
+    bool first = true;
+    std::fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (auto& buffer : s.buffers) {
+        for (const auto& event : buffer->events) {
+            // Spans begun before start() are clipped to it
+            std::uint64_t begin = event.start_ns > s.origin_ns ? event.start_ns - s.origin_ns : 0;
+            std::uint64_t end = event.end_ns > s.origin_ns ? event.end_ns - s.origin_ns : 0;
+            std::fprintf(out, "%s\n{\"name\": \"", first ? "" : ",");
+            write_name(out, event.name);
+            std::fprintf(out,
+                         "\", \"cat\": \"cli\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                         "\"pid\": %ld, \"tid\": %ld}",
+                         static_cast<double>(begin) / 1e3,
+                         static_cast<double>(end - begin) / 1e3, pid, buffer->tid);
+            first = false;
+        }
+        buffer->events.clear();
+    }
+    std::fprintf(out, "\n]}\n");
+    return std::fclose(out) == 0;
+}
+
+} // namespace trace
+} // namespace cli
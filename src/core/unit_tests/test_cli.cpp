@@ -2,6 +2,9 @@
 
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <fstream>
+
 namespace cli {
 namespace {
 
@@ -511,6 +514,407 @@ TEST_F(CliExecutorTest, NestedCommand_NoCallbackShowsHelp) {
     EXPECT_EQ(exit_code, 0);
 }
 
+// Flag index tests
+
+TEST_F(CliExecutorTest, FlagIndex_ManyFlagsResolve) {
+    for (int i = 0; i < 300; ++i) {
+        executor->add_flag("-f" + std::to_string(i) + ",--flag-" + std::to_string(i),
+                           FlagType::Boolean);
+    }
+    executor->add_command("cmd", "Test command", [](const ParseResult&) { return 0; });
+    
+    auto result = executor->parse({"cmd", "--flag-0", "-f150", "--flag-299"});
+    ASSERT_TRUE(result.success);
+    EXPECT_TRUE(result.get_bool("--flag-0"));
+    EXPECT_TRUE(result.get_bool("--flag-150"));
+    EXPECT_TRUE(result.get_bool("--flag-299"));
+    EXPECT_FALSE(result.get_bool("--flag-1"));
+    
+    result = executor->parse({"cmd", "--flag-300"});
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.error_message, "Unknown flag: --flag-300");
+}
+
+TEST_F(CliExecutorTest, FlagIndex_OuterCommandFlagWins) {
+    executor->add_nested_command("parent.child", "Child", [](const ParseResult&) { return 0; });
+    executor->add_nested_command_flag("parent", "-o,--opt", FlagType::Boolean);
+    executor->add_nested_command_flag("parent.child", "-o,--other", FlagType::Boolean);
+    executor->add_flag("-o,--global-opt", FlagType::Boolean);
+    
+    auto result = executor->parse({"parent", "child", "-o", "--other"});
+    ASSERT_TRUE(result.success);
+    EXPECT_TRUE(result.get_bool("--opt"));
+    EXPECT_TRUE(result.get_bool("--other"));
+    EXPECT_FALSE(result.get_bool("--global-opt"));
+}
+
+// Zero-copy parse tests
+
+TEST_F(CliExecutorTest, ParseView_PointsIntoArgv) {
+    executor->add_flag("-v,--verbose", FlagType::Boolean);
+    executor->add_flag("-i,--include", FlagType::MultiArg);
+    executor->set_view_handler([](const ParseView&) { return 0; });
+    
+    char arg0[] = "prog";
+    char arg1[] = "input.txt";
+    char arg2[] = "-v";
+    char arg3[] = "--include=a,b";
+    char* argv[] = {arg0, arg1, arg2, arg3};
+    
+    auto view = executor->parse_view(4, argv);
+    ASSERT_TRUE(view.success);
+    ASSERT_EQ(view.positional_args.size(), 1u);
+    EXPECT_EQ(view.positional_args[0].data(), arg1);
+    EXPECT_TRUE(view.get_bool("--verbose"));
+    EXPECT_FALSE(view.get_bool("--include"));
+    
+    ArgSpan includes = view.get_args("--include");
+    ASSERT_EQ(includes.size(), 2u);
+    EXPECT_EQ(includes[0], "a");
+    EXPECT_EQ(includes[1], "b");
+    EXPECT_EQ(includes[1].data(), arg3 + 12);
+    EXPECT_TRUE(view.get_args("--missing").empty());
+}
+
+TEST_F(CliExecutorTest, ParseView_RunCallsViewHandler) {
+    executor->add_flag("-n,--name", FlagType::MultiArg);
+    std::string seen;
+    executor->set_view_handler([&seen](const ParseView& view) {
+        ArgSpan names = view.get_args("--name");
+        seen = names.empty() ? "" : std::string(names[0]);
+        return static_cast<int>(view.positional_args.size());
+    });
+    
+    char arg0[] = "prog";
+    char arg1[] = "one";
+    char arg2[] = "two";
+    char arg3[] = "--name";
+    char arg4[] = "x";
+    char* argv[] = {arg0, arg1, arg2, arg3, arg4};
+    
+    EXPECT_EQ(executor->run(5, argv), 2);
+    EXPECT_EQ(seen, "x");
+    
+    char bad[] = "--bogus";
+    char* bad_argv[] = {arg0, bad};
+    EXPECT_EQ(executor->run(2, bad_argv), -1);
+}
+
+// Response file tests
+
+std::string write_response_file(const std::string& name, const std::string& contents) {
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream(path, std::ios::binary) << contents;
+    return path.string();
+}
+
+TEST_F(CliExecutorTest, ResponseFile_NewlineEntriesExpanded) {
+    executor->add_flag("-f,--files", FlagType::MultiArg);
+    executor->add_flag("-v,--verbose", FlagType::Boolean);
+    executor->add_command("process", "Process files", [](const ParseResult&) { return 0; });
+    std::string list = write_response_file("cli_test_list.rsp", "a.txt\r\nb c.txt\n\n-v\nd.txt");
+    
+    auto result = executor->parse({"process", "-f", "@" + list, "last"});
+    ASSERT_TRUE(result.success) << result.error_message;
+    auto files = result.get_args("--files");
+    ASSERT_EQ(files.size(), 2u);
+    EXPECT_EQ(files[0], "a.txt");
+    EXPECT_EQ(files[1], "b c.txt");
+    EXPECT_TRUE(result.get_bool("--verbose"));
+    ASSERT_EQ(result.positional_args.size(), 2u);
+    EXPECT_EQ(result.positional_args[0], "d.txt");
+    EXPECT_EQ(result.positional_args[1], "last");
+    std::filesystem::remove(list);
+}
+
+TEST_F(CliExecutorTest, ResponseFile_NulEntriesStayMapped) {
+    executor->set_view_handler([](const ParseView&) { return 0; });
+    std::string list = write_response_file("cli_test_nul.rsp",
+                                           std::string("one\nline\0two\0@nested\0", 21));
+    
+    char arg0[] = "prog";
+    std::string arg1 = "@" + list;
+    char* argv[] = {arg0, arg1.data()};
+    auto view = executor->parse_view(2, argv);
+    std::filesystem::remove(list);
+    ASSERT_TRUE(view.success) << view.error_message;
+    ASSERT_EQ(view.positional_args.size(), 3u);
+    EXPECT_EQ(view.positional_args[0], "one\nline");
+    EXPECT_EQ(view.positional_args[1], "two");
+    EXPECT_EQ(view.positional_args[2], "@nested");  // Not expanded again
+    EXPECT_EQ(view.response_files.size(), 1u);
+}
+
+TEST_F(CliExecutorTest, ResponseFile_MissingFileIsError) {
+    executor->set_handler([](const ParseResult&) { return 0; });
+    auto result = executor->parse({"@/nonexistent/cli_test.rsp"});
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.error_message,
+              "Cannot read response file: /nonexistent/cli_test.rsp (No such file or directory)");
+    
+    // A lone "@" is an ordinary argument
+    result = executor->parse({"@"});
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.positional_args.size(), 1u);
+    EXPECT_EQ(result.positional_args[0], "@");
+}
+
+// Profile flag tests
+
+TEST_F(CliExecutorTest, Profile_HiddenFlagWritesJson) {
+    std::vector<std::string> seen;
+    executor->add_command("cmd", "Test command", [&seen](const ParseResult& result) {
+        seen = result.positional_args;
+        return 4;
+    });
+    auto path = std::filesystem::temp_directory_path() / "cli_test_profile.json";
+    std::string profile = "--profile=" + path.string();
+    
+    char arg0[] = "prog";
+    char arg1[] = "cmd";
+    char arg2[] = "input";
+    char* argv[] = {arg0, profile.data(), arg1, arg2};
+    EXPECT_EQ(executor->run(4, argv), 4);
+    ASSERT_EQ(seen.size(), 1u);
+    EXPECT_EQ(seen[0], "input");
+    
+    std::ifstream in(path);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(json.rfind("{\"program\": \"test_program\"", 0), 0u);
+    EXPECT_NE(json.find("{\"name\": \"register\""), std::string::npos);
+    EXPECT_NE(json.find("{\"name\": \"parse\""), std::string::npos);
+    EXPECT_NE(json.find("{\"name\": \"execute\""), std::string::npos);
+    EXPECT_NE(json.find("\"max_rss_kib\": "), std::string::npos);
+    std::filesystem::remove(path);
+}
+
+TEST_F(CliExecutorTest, Profile_ToolFlagTakesPrecedence) {
+    executor->add_flag("--profile", FlagType::Boolean);
+    bool profiled = false;
+    executor->set_handler([&profiled](const ParseResult& result) {
+        profiled = result.get_bool("--profile");
+        return 0;
+    });
+    
+    char arg0[] = "prog";
+    char arg1[] = "--profile";
+    char* argv[] = {arg0, arg1};
+    EXPECT_EQ(executor->run(2, argv), 0);
+    EXPECT_TRUE(profiled);
+}
+
+TEST_F(CliExecutorTest, Profile_OnlyRecognisedFirst) {
+    executor->add_flag("-f,--files", FlagType::MultiArg);
+    std::vector<std::string> files;
+    bool profiled = false;
+    executor->set_handler([&files](const ParseResult& result) {
+        files = result.get_args("--files");
+        return 0;
+    });
+    executor->add_command("cmd", "Test command", [&profiled](const ParseResult& result) {
+        profiled = result.get_bool("--profile");
+        return 0;
+    });
+    executor->add_command_flag("cmd", "--profile", FlagType::Boolean);
+    
+    // A value of a tool flag is not taken for the hidden flag
+    char arg0[] = "prog";
+    char arg1[] = "--files=--profile";
+    char* argv[] = {arg0, arg1};
+    EXPECT_EQ(executor->run(2, argv), 0);
+    ASSERT_EQ(files.size(), 1u);
+    EXPECT_EQ(files[0], "--profile");
+    
+    // Nor is a command's own --profile
+    char arg2[] = "cmd";
+    char arg3[] = "--profile";
+    char* cmd_argv[] = {arg0, arg2, arg3};
+    EXPECT_EQ(executor->run(3, cmd_argv), 0);
+    EXPECT_TRUE(profiled);
+}
+
+TEST_F(CliExecutorTest, Serve_ToolFlagTakesPrecedence) {
+    executor->add_flag("--serve", FlagType::MultiArg);
+    std::vector<std::string> socket;
+    executor->set_handler([&socket](const ParseResult& result) {
+        socket = result.get_args("--serve");
+        return 6;
+    });
+    
+    char arg0[] = "prog";
+    char arg1[] = "--serve=/tmp/cli_test.sock";
+    char* argv[] = {arg0, arg1};
+    EXPECT_EQ(executor->run(2, argv), 6);
+    ASSERT_EQ(socket.size(), 1u);
+    EXPECT_EQ(socket[0], "/tmp/cli_test.sock");
+}
+
+// Typed flag tests
+
+TEST_F(CliExecutorTest, TypedFlags_ConvertedDuringParse) {
+    executor->add_flag("-n,--offset", FlagType::Int64);
+    executor->add_flag("--count", FlagType::UInt64);
+    executor->add_flag("--ratio", FlagType::Double);
+    executor->add_flag("--size", FlagType::Size);
+    executor->add_flag("--timeout", FlagType::Duration);
+    executor->add_flag("--mode", FlagType::Enum, "", false, {"fast", "safe"});
+    executor->set_handler([](const ParseResult&) { return 0; });
+    
+    auto result = executor->parse({"-n", "-5", "--count=42", "--ratio", "0.25",
+                                   "--size=4K", "--timeout", "1.5s", "--mode=safe", "file"});
+    ASSERT_TRUE(result.success) << result.error_message;
+    EXPECT_EQ(result.get<std::int64_t>("--offset"), -5);
+    EXPECT_EQ(result.get<std::uint64_t>("--count"), 42u);
+    EXPECT_EQ(result.get<double>("--ratio"), 0.25);
+    EXPECT_EQ(result.get<std::uint64_t>("--size"), 4096u);
+    EXPECT_EQ(result.get<std::chrono::nanoseconds>("--timeout"),
+              std::chrono::milliseconds(1500));
+    ASSERT_TRUE(result.get<Choice>("--mode").has_value());
+    EXPECT_EQ(result.get<Choice>("--mode")->index, 1u);
+    ASSERT_EQ(result.positional_args.size(), 1u);
+    
+    // Wrong type requested
+    EXPECT_FALSE(result.get<std::int64_t>("--count").has_value());
+    EXPECT_TRUE(result.get_args("--count").empty());
+}
+
+TEST_F(CliExecutorTest, TypedFlags_SizeAndDurationUnits) {
+    TypedValue value;
+    ASSERT_TRUE(parse_flag_value(FlagType::Size, "3GiB", value));
+    EXPECT_EQ(std::get<std::uint64_t>(value), 3ull << 30);
+    ASSERT_TRUE(parse_flag_value(FlagType::Size, "512", value));
+    EXPECT_EQ(std::get<std::uint64_t>(value), 512u);
+    EXPECT_FALSE(parse_flag_value(FlagType::Size, "1X", value));
+    EXPECT_FALSE(parse_flag_value(FlagType::Size, "99999999999T", value));
+    
+    ASSERT_TRUE(parse_flag_value(FlagType::Duration, "250ms", value));
+    EXPECT_EQ(std::get<std::chrono::nanoseconds>(value), std::chrono::milliseconds(250));
+    ASSERT_TRUE(parse_flag_value(FlagType::Duration, "2m", value));
+    EXPECT_EQ(std::get<std::chrono::nanoseconds>(value), std::chrono::minutes(2));
+    EXPECT_FALSE(parse_flag_value(FlagType::Duration, "5 days", value));
+    EXPECT_FALSE(parse_flag_value(FlagType::UInt64, "-1", value));
+    EXPECT_FALSE(parse_flag_value(FlagType::Int64, "12abc", value));
+}
+
+TEST_F(CliExecutorTest, TypedFlags_ErrorsReportedByParse) {
+    executor->add_flag("--count", FlagType::UInt64);
+    executor->add_flag("--mode", FlagType::Enum, "", false, {"fast", "safe"});
+    executor->set_handler([](const ParseResult&) { return 0; });
+    
+    auto result = executor->parse({"--count", "ten"});
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.error_message, "Invalid value for --count: 'ten' (expected count)");
+    
+    result = executor->parse({"--mode=slow"});
+    EXPECT_EQ(result.error_message, "Invalid value for --mode: 'slow' (expected fast|safe)");
+    
+    result = executor->parse({"--count"});
+    EXPECT_EQ(result.error_message, "Missing value for flag: --count");
+    
+    EXPECT_NE(executor->help().find("--mode <fast|safe>"), std::string::npos);
+}
+
+// Lazy command tests
+
+TEST_F(CliExecutorTest, LazyCommand_FactoryRunsOnlyWhenReached) {
+    int built_2024 = 0;
+    int built_2025 = 0;
+    executor->add_lazy_command("year-2024", "2024", [&](CommandBuilder& year) {
+        ++built_2024;
+        year.add_command("day-1.part-1", "Part 1", [](const ParseResult&) { return 41; });
+        year.add_command_flag("day-1.part-1", "-i,--input", FlagType::MultiArg);
+    });
+    executor->add_lazy_command("year-2025", "2025", [&](CommandBuilder&) { ++built_2025; });
+    EXPECT_EQ(built_2024, 0);
+    
+    auto result = executor->parse({"year-2024", "day-1", "part-1", "-i", "in.txt"});
+    ASSERT_TRUE(result.success) << result.error_message;
+    EXPECT_EQ(result.get_args("--input"), std::vector<std::string>{"in.txt"});
+    EXPECT_EQ(executor->execute(result), 41);
+    
+    result = executor->parse({"year-2024", "day-1", "part-1"});
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(built_2024, 1);
+    EXPECT_EQ(built_2025, 0);
+    
+    // Listing top-level commands needs no expansion
+    EXPECT_NE(executor->help().find("year-2025"), std::string::npos);
+    EXPECT_EQ(built_2025, 0);
+}
+
+TEST_F(CliExecutorTest, LazyCommand_NestedFactoriesAndHelp) {
+    int built_days = 0;
+    executor->add_lazy_command("year", "Years", [&](CommandBuilder& year) {
+        year.add_flag("--fast", FlagType::Boolean);
+        year.add_lazy_command("day-1", "Day one", [&](CommandBuilder& day) {
+            ++built_days;
+            day.set_callback([](const ParseResult& r) { return r.get_bool("--fast") ? 2 : 1; });
+            day.add_command("part-1", "Part 1", [](const ParseResult&) { return 0; });
+        });
+    });
+    
+    auto help = executor->help(std::vector<std::string>{"year"});
+    EXPECT_NE(help.find("day-1\tDay one"), std::string::npos);
+    EXPECT_EQ(built_days, 0);
+    
+    help = executor->help(std::vector<std::string>{"year", "day-1"});
+    EXPECT_NE(help.find("part-1"), std::string::npos);
+    EXPECT_EQ(built_days, 1);
+    
+    auto result = executor->parse({"year", "day-1", "--fast"});
+    ASSERT_TRUE(result.success) << result.error_message;
+    EXPECT_EQ(executor->execute(result), 2);
+    EXPECT_EQ(built_days, 1);
+}
+
+// Command trie tests
+
+TEST(CommandTrieTest, FindInsertAndChildren) {
+    CommandTrie trie;
+    std::uint32_t year = trie.insert(CommandTrie::kRoot, "year");
+    for (int i = 999; i >= 0; --i) {
+        std::uint32_t day = trie.insert(year, "day-" + std::to_string(i));
+        trie.insert(day, "part-1");
+    }
+    EXPECT_EQ(trie.insert(CommandTrie::kRoot, "year"), year);
+    EXPECT_EQ(trie.size(), 2002u);
+    
+    std::uint32_t day = trie.find(year, "day-500");
+    ASSERT_NE(day, 0u);
+    EXPECT_EQ(trie.parent(day), year);
+    EXPECT_EQ(trie.name(day), "day-500");
+    
+    // The same name under different parents is a different command
+    std::uint32_t part = trie.find(day, "part-1");
+    ASSERT_NE(part, 0u);
+    EXPECT_NE(part, trie.find(trie.find(year, "day-501"), "part-1"));
+    EXPECT_EQ(trie.find(year, "part-1"), 0u);
+    EXPECT_EQ(trie.find(CommandTrie::kRoot, "day-500"), 0u);
+    
+    auto children = trie.children(year);
+    ASSERT_EQ(children.size(), 1000u);
+    EXPECT_EQ(trie.name(children[0]), "day-0");
+    EXPECT_EQ(trie.name(children[1]), "day-1");
+}
+
+TEST_F(CliExecutorTest, ParseResult_CarriesResolvedCommand) {
+    executor->add_nested_command("a.b.c", "Leaf", [](const ParseResult&) { return 3; });
+    
+    auto result = executor->parse({"a", "b", "c", "x"});
+    ASSERT_TRUE(result.success);
+    EXPECT_NE(result.command_id, 0u);
+    
+    // Execution uses the resolved command rather than the path again
+    result.command_path = {"not", "there"};
+    EXPECT_EQ(executor->execute(result), 3);
+    
+    // A hand-made result is resolved from its path
+    ParseResult manual;
+    manual.success = true;
+    manual.command_path = {"a", "b", "c"};
+    EXPECT_EQ(executor->execute(manual), 3);
+}
+
 } // namespace
 } // namespace cli
 
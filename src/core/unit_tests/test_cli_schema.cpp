@@ -0,0 +1,174 @@
+#include "cli_schema.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+namespace cli {
+namespace {
+
+int handle_add(const ParseView& view) {
+    return static_cast<int>(view.positional_args.size());
+}
+
+int handle_list(const ParseView&) {
+    return 7;
+}
+
+constexpr CommandSpec kCommands[] = {
+    {"remote", "Manage remotes"},
+    {"remote.add", "Add a remote", handle_add},
+    {"list", "List things", handle_list},
+};
+
+constexpr FlagSpec kFlags[] = {
+    {"-v,--verbose", FlagType::Boolean, "Verbose output"},
+    {"-o,--output", FlagType::MultiArg, "Output files"},
+    {"--name", FlagType::MultiArg, "Remote name", true, "remote.add"},
+    {"-f,--force", FlagType::Boolean, "Overwrite", false, "remote"},
+    {"--limit", FlagType::Size, "Size limit"},
+    {"--mode", FlagType::Enum, "Mode", false, {}, "fast|safe"},
+};
+
+constexpr auto kSchema = make_schema({"tool", "A schema tool"}, kCommands, kFlags);
+
+// Lookups resolve at compile time; a misspelt name would not compile
+constexpr std::string_view kVerbose = kSchema.flag("-v");
+constexpr std::string_view kOutput = kSchema.flag("-o");
+static_assert(kVerbose == "--verbose");
+static_assert(kSchema.flag("--help") == "--help");
+static_assert(kSchema.command("remote.add") == 1);
+
+std::vector<std::string_view> args(std::initializer_list<std::string_view> list) {
+    return std::vector<std::string_view>(list);
+}
+
+TEST(CliSchemaTest, ParseNestedCommandAndScopedFlags) {
+    std::size_t command = kSchema.kNone;
+    auto view = kSchema.parse(args({"remote", "add", "-f", "--name=origin", "url", "-v"}),
+                              &command);
+    ASSERT_TRUE(view.success) << view.error_message;
+    EXPECT_EQ(command, kSchema.command("remote.add"));
+    ASSERT_EQ(view.command_path.size(), 2u);
+    EXPECT_EQ(view.command_path[1], "add");
+    EXPECT_TRUE(view.get_bool("--force"));
+    EXPECT_TRUE(view.get_bool(kVerbose));
+    ASSERT_EQ(view.get_args("--name").size(), 1u);
+    EXPECT_EQ(view.get_args("--name")[0], "origin");
+    ASSERT_EQ(view.positional_args.size(), 1u);
+    EXPECT_EQ(view.positional_args[0], "url");
+}
+
+TEST(CliSchemaTest, ParseErrorsMatchCliExecutor) {
+    auto view = kSchema.parse(args({}));
+    EXPECT_FALSE(view.success);
+    EXPECT_EQ(view.error_message, "No command specified");
+
+    view = kSchema.parse(args({"bogus"}));
+    EXPECT_EQ(view.error_message, "Unknown command: bogus");
+
+    // Command flags are not visible outside their command
+    view = kSchema.parse(args({"list", "-f"}));
+    EXPECT_EQ(view.error_message, "Unknown flag: -f");
+
+    view = kSchema.parse(args({"remote", "add", "url"}));
+    EXPECT_EQ(view.error_message, "Missing required flag: --name");
+
+    view = kSchema.parse(args({"list", "-o", "a", "b", "--output=c,d"}));
+    ASSERT_TRUE(view.success);
+    ASSERT_EQ(view.get_args(kOutput).size(), 2u);
+    EXPECT_EQ(view.get_args(kOutput)[1], "d");
+}
+
+TEST(CliSchemaTest, TypedFlagsConverted) {
+    auto view = kSchema.parse(args({"list", "--limit", "2M", "--mode=safe"}));
+    ASSERT_TRUE(view.success) << view.error_message;
+    EXPECT_EQ(view.get<std::uint64_t>("--limit"), 2u << 20);
+    ASSERT_TRUE(view.get<Choice>("--mode").has_value());
+    EXPECT_EQ(view.get<Choice>("--mode")->index, 1u);
+
+    view = kSchema.parse(args({"list", "--mode", "slow"}));
+    EXPECT_EQ(view.error_message, "Invalid value for --mode: 'slow' (expected fast|safe)");
+}
+
+TEST(CliSchemaTest, ResponseFilesExpanded) {
+    auto path = std::filesystem::temp_directory_path() / "cli_schema_test.rsp";
+    std::ofstream(path) << "remote\nadd\n--name=origin\nurl\n";
+    std::string arg = "@" + path.string();
+
+    std::size_t command = kSchema.kNone;
+    auto view = kSchema.parse(args({arg, "-v"}), &command);
+    std::filesystem::remove(path);
+    ASSERT_TRUE(view.success) << view.error_message;
+    EXPECT_EQ(command, kSchema.command("remote.add"));
+    EXPECT_EQ(view.get_args("--name")[0], "origin");
+    EXPECT_TRUE(view.get_bool(kVerbose));
+    ASSERT_EQ(view.positional_args.size(), 1u);
+    EXPECT_EQ(view.positional_args[0], "url");
+    EXPECT_EQ(view.response_files.size(), 1u);
+
+    view = kSchema.parse(args({"list", "@/nonexistent/cli_schema_test.rsp"}));
+    EXPECT_EQ(view.error_message,
+              "Cannot read response file: /nonexistent/cli_schema_test.rsp "
+              "(No such file or directory)");
+}
+
+TEST(CliSchemaTest, DuplicateFlagsDetectedAcrossScopes) {
+    constexpr CommandSpec commands[] = {{"a", "A"}, {"b", "B"}};
+    // Same name in scopes a, b, a: the duplicates are not declared together
+    constexpr FlagSpec flags[] = {
+        {"--x", FlagType::Boolean, "", false, "a"},
+        {"--x", FlagType::Boolean, "", false, "b"},
+        {"--x", FlagType::Boolean, "", false, "a"},
+    };
+    EXPECT_THROW(make_schema({"tool"}, commands, flags), std::logic_error);
+    EXPECT_NO_THROW(make_schema({"tool"}, commands, {flags[0], flags[1]}));
+}
+
+TEST(CliSchemaTest, RunDispatchesToHandlers) {
+    using Cli = StaticCli<kSchema>;
+    char prog[] = "tool";
+    char list[] = "list";
+    char* list_argv[] = {prog, list};
+    EXPECT_EQ(Cli::run(2, list_argv), 7);
+
+    char remote[] = "remote";
+    char add[] = "add";
+    char name[] = "--name=x";
+    char url[] = "url";
+    char* add_argv[] = {prog, remote, add, name, url};
+    EXPECT_EQ(Cli::run(5, add_argv), 1);
+}
+
+TEST(CliSchemaTest, RunTakesHiddenProfileFlag) {
+    auto path = std::filesystem::temp_directory_path() / "cli_schema_profile.json";
+    std::string profile = "--profile=" + path.string();
+    char prog[] = "tool";
+    char list[] = "list";
+    char* argv[] = {prog, profile.data(), list};
+    EXPECT_EQ(StaticCli<kSchema>::run(3, argv), 7);
+
+    std::ifstream in(path);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(json.rfind("{\"program\": \"tool\"", 0), 0u);
+    EXPECT_NE(json.find("{\"name\": \"parse\""), std::string::npos);
+    EXPECT_NE(json.find("{\"name\": \"execute\""), std::string::npos);
+    std::filesystem::remove(path);
+}
+
+TEST(CliSchemaTest, HelpGeneratedAtCompileTime) {
+    constexpr std::string_view help = StaticCli<kSchema>::help();
+    EXPECT_EQ(help.substr(0, 22), "tool - A schema tool\n\n");
+    EXPECT_NE(help.find("Commands:\n  list\tList things\n  remote\tManage remotes\n"),
+              std::string_view::npos);
+    EXPECT_NE(help.find("  -o, --output <args>\tOutput files\n"), std::string_view::npos);
+
+    constexpr std::string_view add_help = StaticCli<kSchema>::help("remote.add");
+    EXPECT_NE(add_help.find("Usage: tool remote add [options]"), std::string_view::npos);
+    EXPECT_NE(add_help.find("  --name <args>\tRemote name (required)\n"),
+              std::string_view::npos);
+}
+
+} // namespace
+} // namespace cli
@@ -0,0 +1,60 @@
+#include "multicall.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace cli {
+namespace {
+
+std::string last_argv0;
+
+int first_tool(int argc, char* argv[]) {
+    last_argv0 = argv[0];
+    return argc;
+}
+
+int second_tool(int, char*[]) {
+    return 42;
+}
+
+// Registered the way CLI_TOOL_MAIN does in a multi-call build
+const bool first_registered = register_tool("first-tool", first_tool);
+const bool second_registered = register_tool("second-tool", second_tool);
+
+TEST(MulticallTest, ToolsRegisteredSorted) {
+    EXPECT_TRUE(first_registered && second_registered);
+    auto tools = registered_tools();
+    ASSERT_EQ(tools.size(), 2u);
+    EXPECT_EQ(tools[0], "first-tool");
+    EXPECT_EQ(tools[1], "second-tool");
+}
+
+TEST(MulticallTest, DispatchOnArgv0Basename) {
+    char prog[] = "/usr/local/bin/second-tool";
+    char* argv[] = {prog};
+    EXPECT_EQ(multicall_main(1, argv), 42);
+}
+
+TEST(MulticallTest, DispatchOnFirstArgument) {
+    char prog[] = "cpp-cli";
+    char tool[] = "first-tool";
+    char arg[] = "--help";
+    char* argv[] = {prog, tool, arg};
+    EXPECT_EQ(multicall_main(3, argv), 2);
+    EXPECT_EQ(last_argv0, "first-tool");
+}
+
+TEST(MulticallTest, UnknownToolFails) {
+    char prog[] = "cpp-cli";
+    char tool[] = "missing";
+    char* argv[] = {prog, tool};
+    EXPECT_EQ(multicall_main(2, argv), 1);
+
+    char help[] = "--help";
+    char* help_argv[] = {prog, help};
+    EXPECT_EQ(multicall_main(2, help_argv), 0);
+}
+
+} // namespace
+} // namespace cli
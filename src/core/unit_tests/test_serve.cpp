@@ -0,0 +1,195 @@
+#include "cli.hpp"
+#include "serve.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace cli {
+namespace {
+
+class ServeTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        executor.add_command("echo", "Print arguments", [](const ParseResult& result) {
+            for (const auto& arg : result.positional_args) {
+                std::printf("%s\n", arg.c_str());
+            }
+            return 0;
+        });
+        executor.add_command("fail", "Report an error", [](const ParseResult&) {
+            std::fprintf(stderr, "failed\n");
+            return 3;
+        });
+        executor.add_lazy_command("lazy", "Built on first use", [this](CommandBuilder& builder) {
+            ++expansions;
+            builder.set_callback([](const ParseResult&) { return 5; });
+        });
+    }
+
+    CliExecutor executor{"tool", "Serve test tool"};
+    int expansions = 0;
+};
+
+std::string read_everything(int fd) {
+    std::string text;
+    char chunk[256];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        text.append(chunk, static_cast<size_t>(n));
+    }
+    return text;
+}
+
+TEST(ServeProtocolTest, RequestAndResponseRoundTrip) {
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    std::vector<std::string> sent = {"copy", "", "a\tb c", "--flag=1"};
+    ASSERT_TRUE(write_request(fds[1], sent));
+    ASSERT_TRUE(write_response(fds[1], {-1, "out", ""}));
+    ::close(fds[1]);
+
+    std::vector<std::string> received;
+    ASSERT_TRUE(read_request(fds[0], received));
+    EXPECT_EQ(received, sent);
+    ServeResponse response;
+    ASSERT_TRUE(read_response(fds[0], response));
+    EXPECT_EQ(response.exit_code, -1);
+    EXPECT_EQ(response.out, "out");
+    EXPECT_EQ(response.err, "");
+    EXPECT_FALSE(read_request(fds[0], received));
+    ::close(fds[0]);
+}
+
+TEST_F(ServeTest, LengthPrefixedRequestsCaptureOutput) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ASSERT_TRUE(write_request(fds[0], {"echo", "hello", "world"}));
+    ASSERT_TRUE(write_request(fds[0], {"fail"}));
+    ASSERT_TRUE(write_request(fds[0], {"bogus"}));
+    ::shutdown(fds[0], SHUT_WR);
+
+    EXPECT_EQ(executor.serve_stream(fds[1], fds[1], ServeFraming::LengthPrefixed), 0);
+    ::close(fds[1]);
+
+    ServeResponse response;
+    ASSERT_TRUE(read_response(fds[0], response));
+    EXPECT_EQ(response.exit_code, 0);
+    EXPECT_EQ(response.out, "hello\nworld\n");
+    EXPECT_EQ(response.err, "");
+
+    ASSERT_TRUE(read_response(fds[0], response));
+    EXPECT_EQ(response.exit_code, 3);
+    EXPECT_EQ(response.out, "");
+    EXPECT_EQ(response.err, "failed\n");
+
+    ASSERT_TRUE(read_response(fds[0], response));
+    EXPECT_EQ(response.exit_code, -1);
+    EXPECT_EQ(response.err.rfind("Error: Unknown command: bogus\n", 0), 0u);
+    EXPECT_FALSE(read_response(fds[0], response));
+    ::close(fds[0]);
+}
+
+TEST_F(ServeTest, LineRequestsAreTabSeparated) {
+    int in[2];
+    int out[2];
+    ASSERT_EQ(::pipe(in), 0);
+    ASSERT_EQ(::pipe(out), 0);
+    std::string requests = "echo\ta b\tc\nfail";
+    ASSERT_EQ(::write(in[1], requests.data(), requests.size()),
+              static_cast<ssize_t>(requests.size()));
+    ::close(in[1]);
+
+    EXPECT_EQ(executor.serve_stream(in[0], out[1], ServeFraming::Lines), 0);
+    ::close(in[0]);
+    ::close(out[1]);
+
+    EXPECT_EQ(read_everything(out[0]), "0 6 0\na b\nc\n3 0 7\nfailed\n");
+    ::close(out[0]);
+}
+
+TEST_F(ServeTest, LazyCommandsStayExpandedAcrossRequests) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(write_request(fds[0], {"lazy"}));
+    }
+    ::shutdown(fds[0], SHUT_WR);
+    executor.serve_stream(fds[1], fds[1], ServeFraming::LengthPrefixed);
+    ::close(fds[1]);
+
+    ServeResponse response;
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(read_response(fds[0], response));
+        EXPECT_EQ(response.exit_code, 5);
+    }
+    EXPECT_EQ(expansions, 1);
+    ::close(fds[0]);
+}
+
+TEST_F(ServeTest, ExistingFileAtSocketPathIsKept) {
+    char path[] = "/tmp/serve_test_XXXXXX";
+    int fd = ::mkstemp(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::write(fd, "keep", 4), 4);
+    ::close(fd);
+
+    EXPECT_EQ(executor.serve(path), -1);
+    struct stat st;
+    ASSERT_EQ(::stat(path, &st), 0);
+    EXPECT_TRUE(S_ISREG(st.st_mode));
+    EXPECT_EQ(st.st_size, 4);
+    ::unlink(path);
+}
+
+TEST_F(ServeTest, SecondServerLeavesLiveSocketAlone) {
+    char dir[] = "/tmp/serve_test_XXXXXX";
+    ASSERT_NE(::mkdtemp(dir), nullptr);
+    std::string path = std::string(dir) + "/sock";
+
+    pid_t first = ::fork();
+    ASSERT_GE(first, 0);
+    if (first == 0) {
+        executor.serve(path);
+        ::_exit(1);
+    }
+    int fd = -1;
+    for (int i = 0; i < 500 && fd < 0; ++i) {
+        if ((fd = connect_server(path)) < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    ASSERT_GE(fd, 0);
+    ::close(fd);
+    struct stat st;
+    ASSERT_EQ(::stat(path.c_str(), &st), 0);
+    EXPECT_EQ(st.st_mode & 0777, 0600u);
+
+    EXPECT_EQ(executor.serve(path), -1);
+
+    // The first server still answers
+    fd = connect_server(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_TRUE(write_request(fd, {"echo", "still"}));
+    ServeResponse response;
+    ASSERT_TRUE(read_response(fd, response));
+    EXPECT_EQ(response.out, "still\n");
+    ::close(fd);
+
+    ::kill(first, SIGTERM);
+    ::waitpid(first, nullptr, 0);
+    ::unlink(path.c_str());
+    ::rmdir(dir);
+}
+
+} // namespace
+} // namespace cli
@@ -0,0 +1,92 @@
+#include "cli.hpp"
+#include "trace.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace cli {
+namespace {
+
+std::string read_file(const std::filesystem::path& path) {
+    std::ifstream in(path);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+size_t count(const std::string& text, const std::string& part) {
+    size_t n = 0;
+    for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+TEST(TraceTest, SpansWrittenAsTraceEvents) {
+    auto path = std::filesystem::temp_directory_path() / "cli_test_trace.json";
+    ASSERT_TRUE(trace::start(path.string()));
+    EXPECT_TRUE(trace::enabled());
+    EXPECT_FALSE(trace::start(path.string()));
+    
+    {
+        CLI_TRACE_SPAN("outer \"span\"");
+        std::thread worker([] { CLI_TRACE_SPAN("worker"); });
+        worker.join();
+    }
+    CliExecutor executor("prog");
+    executor.add_command("cmd", "Command", [](const ParseResult&) { return 0; });
+    executor.execute(executor.parse({"cmd"}));
+    
+    ASSERT_TRUE(trace::stop());
+    EXPECT_FALSE(trace::enabled());
+    
+    std::string json = read_file(path);
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [", 0), 0u);
+    EXPECT_EQ(count(json, "\"ph\": \"X\""), 4u);
+    EXPECT_EQ(count(json, "\"name\": \"outer \\\"span\\\"\""), 1u);
+    EXPECT_EQ(count(json, "\"name\": \"worker\""), 1u);
+    EXPECT_EQ(count(json, "\"name\": \"CliExecutor::parse\""), 1u);
+    EXPECT_EQ(count(json, "\"name\": \"CliExecutor::execute\""), 1u);
+    std::filesystem::remove(path);
+}
+
+TEST(TraceTest, NothingRecordedWhileDisabled) {
+    ASSERT_FALSE(trace::enabled());
+    {
+        CLI_TRACE_SPAN("ignored");
+    }
+    
+    auto path = std::filesystem::temp_directory_path() / "cli_test_trace_empty.json";
+    ASSERT_TRUE(trace::start(path.string()));
+    ASSERT_TRUE(trace::stop());
+    EXPECT_EQ(count(read_file(path), "\"ph\""), 0u);
+    EXPECT_FALSE(trace::stop());
+    std::filesystem::remove(path);
+}
+
+TEST(TraceTest, SpanOpenAcrossStopIsDropped) {
+    auto first = std::filesystem::temp_directory_path() / "cli_test_trace_first.json";
+    auto second = std::filesystem::temp_directory_path() / "cli_test_trace_second.json";
+    ASSERT_TRUE(trace::start(first.string()));
+    {
+        CLI_TRACE_SPAN("late");
+        ASSERT_TRUE(trace::stop());
+        ASSERT_TRUE(trace::start(second.string()));
+    }
+    {
+        CLI_TRACE_SPAN("current");
+    }
+    ASSERT_TRUE(trace::stop());
+    
+    EXPECT_EQ(count(read_file(first), "\"ph\""), 0u);
+    std::string json = read_file(second);
+    EXPECT_EQ(count(json, "\"name\": \"late\""), 0u);
+    EXPECT_EQ(count(json, "\"name\": \"current\""), 1u);
+    std::filesystem::remove(first);
+    std::filesystem::remove(second);
+}
+
+} // namespace
+} // namespace cli
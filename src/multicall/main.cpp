@@ -0,0 +1,5 @@
+#include "multicall.hpp"
+
+int main(int argc, char* argv[]) {
+    return cli::multicall_main(argc, argv);
+}
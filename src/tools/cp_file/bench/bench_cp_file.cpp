@@ -0,0 +1,464 @@
+// Benchmark harness for cp_file copy strategies.
+//
+// Runs every strategy over synthetic workloads in a fixture directory
+// (point --dir at a tmpfs or a local disk) and prints throughput and the
+// number of system calls each strategy issued per file. Caches are warm:
+// every source is read once before it is timed.
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cli.hpp"
+#include "cp_file.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+using cp_file::detail::UniqueFd;
+
+/// Outcome of copying one file with one strategy
+struct StrategyResult {
+  bool ok = false;
+  bool unsupported = false;    // The kernel or filesystem lacks the feature
+  std::uint64_t syscalls = 0;  // Calls issued by the strategy itself
+};
+
+/// Copy src to dst; counts syscalls unless the strategy is opaque
+using CopyFn =
+    std::function<StrategyResult(const std::string&, const std::string&)>;
+
+struct Strategy {
+  const char* name;
+  bool opaque;  // Syscalls happen inside a library and are not counted
+  CopyFn copy;
+};
+
+constexpr std::size_t kBufferSize = 1 << 20;
+constexpr unsigned kParallelChunks = 4;
+
+/// Open both ends and fstat the source, counting three calls
+bool open_pair(const std::string& src, const std::string& dst, UniqueFd& in,
+               UniqueFd& out, struct stat& st, StrategyResult& r) {
+  in.reset(::open(src.c_str(), O_RDONLY | O_CLOEXEC));
+  out.reset(::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644));
+  r.syscalls += 3;
+  return in.valid() && out.valid() && ::fstat(in.get(), &st) == 0;
+}
+
+StrategyResult copy_std_filesystem(const std::string& src,
+                                   const std::string& dst) {
+  StrategyResult r;
+  std::error_code ec;
+  fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
+  r.ok = !ec;
+  return r;
+}
+
+StrategyResult copy_cp_file(const std::string& src, const std::string& dst) {
+  StrategyResult r;
+  r.ok = cp_file::copy_file(src, dst, true).success;
+  return r;
+}
+
+StrategyResult copy_read_write(const std::string& src,
+                               const std::string& dst) {
+  StrategyResult r;
+  UniqueFd in;
+  UniqueFd out;
+  struct stat st;
+  if (!open_pair(src, dst, in, out, st, r)) {
+    return r;
+  }
+  auto buffer = cp_file::detail::make_aligned_buffer(kBufferSize);
+  for (;;) {
+    ssize_t n = ::read(in.get(), buffer.get(), kBufferSize);
+    ++r.syscalls;
+    if (n < 0) {
+      return r;
+    }
+    if (n == 0) {
+      break;
+    }
+    ++r.syscalls;
+    if (!cp_file::detail::write_all(out.get(), buffer.get(),
+                                    static_cast<std::size_t>(n))) {
+      return r;
+    }
+  }
+  r.ok = true;
+  return r;
+}
+
+StrategyResult copy_with_copy_file_range(const std::string& src,
+                                         const std::string& dst) {
+  StrategyResult r;
+  UniqueFd in;
+  UniqueFd out;
+  struct stat st;
+  if (!open_pair(src, dst, in, out, st, r)) {
+    return r;
+  }
+  auto remaining = static_cast<std::uint64_t>(st.st_size);
+  while (remaining > 0) {
+    ssize_t n = ::copy_file_range(in.get(), nullptr, out.get(), nullptr,
+                                  remaining, 0);
+    ++r.syscalls;
+    if (n < 0) {
+      r.unsupported = errno == ENOSYS || errno == EXDEV;
+      return r;
+    }
+    if (n == 0) {
+      break;
+    }
+    remaining -= static_cast<std::uint64_t>(n);
+  }
+  r.ok = true;
+  return r;
+}
+
+StrategyResult copy_with_sendfile(const std::string& src,
+                                  const std::string& dst) {
+  StrategyResult r;
+  UniqueFd in;
+  UniqueFd out;
+  struct stat st;
+  if (!open_pair(src, dst, in, out, st, r)) {
+    return r;
+  }
+  auto remaining = static_cast<std::uint64_t>(st.st_size);
+  while (remaining > 0) {
+    ssize_t n = ::sendfile(out.get(), in.get(), nullptr, remaining);
+    ++r.syscalls;
+    if (n <= 0) {
+      r.unsupported = n < 0 && errno == EINVAL;
+      return r;
+    }
+    remaining -= static_cast<std::uint64_t>(n);
+  }
+  r.ok = true;
+  return r;
+}
+
+StrategyResult copy_with_mmap(const std::string& src, const std::string& dst) {
+  StrategyResult r;
+  UniqueFd in;
+  UniqueFd out;
+  struct stat st;
+  if (!open_pair(src, dst, in, out, st, r)) {
+    return r;
+  }
+  auto size = static_cast<std::size_t>(st.st_size);
+  if (size == 0) {
+    r.ok = true;
+    return r;
+  }
+  void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, in.get(), 0);
+  ++r.syscalls;
+  if (map == MAP_FAILED) {
+    return r;
+  }
+  ::madvise(map, size, MADV_SEQUENTIAL);
+  ++r.syscalls;
+  r.ok = cp_file::detail::write_all(out.get(), static_cast<char*>(map), size);
+  r.syscalls += (size + kBufferSize - 1) / kBufferSize;  // Lower bound
+  ::munmap(map, size);
+  ++r.syscalls;
+  return r;
+}
+
+StrategyResult copy_with_reflink(const std::string& src,
+                                 const std::string& dst) {
+  StrategyResult r;
+  UniqueFd in;
+  UniqueFd out;
+  struct stat st;
+  if (!open_pair(src, dst, in, out, st, r)) {
+    return r;
+  }
+  ++r.syscalls;
+  if (::ioctl(out.get(), FICLONE, in.get()) != 0) {
+    r.unsupported = true;
+    return r;
+  }
+  r.ok = true;
+  return r;
+}
+
+StrategyResult copy_parallel_chunked(const std::string& src,
+                                     const std::string& dst) {
+  StrategyResult r;
+  UniqueFd in;
+  UniqueFd out;
+  struct stat st;
+  if (!open_pair(src, dst, in, out, st, r)) {
+    return r;
+  }
+  auto size = static_cast<std::uint64_t>(st.st_size);
+  ++r.syscalls;
+  if (::ftruncate(out.get(), static_cast<off_t>(size)) != 0) {
+    return r;
+  }
+
+  // Each worker copies one contiguous range with pread/pwrite
+  std::uint64_t chunk = (size + kParallelChunks - 1) / kParallelChunks;
+  std::vector<std::thread> workers;
+  std::vector<std::uint64_t> calls(kParallelChunks, 0);
+  std::vector<char> ok(kParallelChunks, 1);
+  for (unsigned w = 0; w < kParallelChunks && chunk > 0; ++w) {
+    workers.emplace_back([&, w] {
+      auto buffer = cp_file::detail::make_aligned_buffer(kBufferSize);
+      std::uint64_t begin = w * chunk;
+      std::uint64_t end = std::min(size, begin + chunk);
+      for (std::uint64_t pos = begin; pos < end; pos += kBufferSize) {
+        auto len = static_cast<std::size_t>(
+            std::min<std::uint64_t>(kBufferSize, end - pos));
+        calls[w] += 2;
+        if (!cp_file::detail::pread_all(in.get(), buffer.get(), len,
+                                        static_cast<off_t>(pos)) ||
+            !cp_file::detail::pwrite_all(out.get(), buffer.get(), len,
+                                         static_cast<off_t>(pos))) {
+          ok[w] = 0;
+          return;
+        }
+      }
+    });
+  }
+  r.ok = true;
+  for (unsigned w = 0; w < workers.size(); ++w) {
+    workers[w].join();
+    r.syscalls += calls[w];
+    r.ok = r.ok && ok[w];
+  }
+  return r;
+}
+
+const std::vector<Strategy>& strategies() {
+  static const std::vector<Strategy> all = {
+      {"std::filesystem", true, copy_std_filesystem},
+      {"cp_file", true, copy_cp_file},
+      {"read/write", false, copy_read_write},
+      {"copy_file_range", false, copy_with_copy_file_range},
+      {"sendfile", false, copy_with_sendfile},
+      {"mmap", false, copy_with_mmap},
+      {"reflink", false, copy_with_reflink},
+      {"parallel", false, copy_parallel_chunked},
+  };
+  return all;
+}
+
+/// A set of source files with the same shape
+struct Workload {
+  std::string name;
+  std::vector<std::string> files;
+  std::uint64_t bytes = 0;
+};
+
+bool write_pattern(const std::string& path, std::uint64_t size) {
+  UniqueFd fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644));
+  if (!fd.valid()) {
+    return false;
+  }
+  std::vector<char> block(kBufferSize);
+  for (std::size_t i = 0; i < block.size(); ++i) {
+    block[i] = static_cast<char>((i * 131) % 251);
+  }
+  for (std::uint64_t pos = 0; pos < size; pos += block.size()) {
+    auto len = static_cast<std::size_t>(
+        std::min<std::uint64_t>(block.size(), size - pos));
+    if (!cp_file::detail::write_all(fd.get(), block.data(), len)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// One file of `size` bytes with data only in every 16th MiB
+bool write_sparse(const std::string& path, std::uint64_t size) {
+  UniqueFd fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644));
+  if (!fd.valid() || ::ftruncate(fd.get(), static_cast<off_t>(size)) != 0) {
+    return false;
+  }
+  std::vector<char> block(64 * 1024, 'S');
+  for (std::uint64_t pos = 0; pos + block.size() <= size; pos += 16 << 20) {
+    if (!cp_file::detail::pwrite_all(fd.get(), block.data(), block.size(),
+                                     static_cast<off_t>(pos))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Read every source once so all strategies start from a warm cache
+void warm(const Workload& workload) {
+  auto buffer = cp_file::detail::make_aligned_buffer(kBufferSize);
+  for (const auto& file : workload.files) {
+    UniqueFd fd(::open(file.c_str(), O_RDONLY | O_CLOEXEC));
+    while (fd.valid() && ::read(fd.get(), buffer.get(), kBufferSize) > 0) {
+    }
+  }
+}
+
+std::uint64_t allocated_bytes(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0
+             ? static_cast<std::uint64_t>(st.st_blocks) * 512
+             : 0;
+}
+
+void run_workload(const Workload& workload, const fs::path& out_dir,
+                  const std::string& only) {
+  warm(workload);
+  for (const auto& strategy : strategies()) {
+    if (!only.empty() && only != strategy.name) {
+      continue;
+    }
+    fs::remove_all(out_dir);
+    fs::create_directories(out_dir);
+
+    std::uint64_t syscalls = 0;
+    std::uint64_t allocated = 0;
+    bool ok = true;
+    bool unsupported = false;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < workload.files.size() && ok; ++i) {
+      std::string dst = (out_dir / std::to_string(i)).string();
+      auto r = strategy.copy(workload.files[i], dst);
+      ok = r.ok;
+      unsupported = r.unsupported;
+      syscalls += r.syscalls;
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    if (!ok) {
+      std::printf("%-8s %-16s %s\n", workload.name.c_str(), strategy.name,
+                  unsupported ? "unsupported" : "FAILED");
+      continue;
+    }
+    for (std::size_t i = 0; i < workload.files.size(); ++i) {
+      allocated += allocated_bytes((out_dir / std::to_string(i)).string());
+    }
+
+    char per_file[32] = "-";
+    if (!strategy.opaque) {
+      std::snprintf(per_file, sizeof(per_file), "%.1f",
+                    static_cast<double>(syscalls) /
+                        static_cast<double>(workload.files.size()));
+    }
+    double mb = static_cast<double>(workload.bytes) / (1000.0 * 1000.0);
+    std::printf("%-8s %-16s %10.3f %10.1f %12s %12s\n", workload.name.c_str(),
+                strategy.name, seconds, seconds > 0 ? mb / seconds : 0.0,
+                per_file, cp_file::format_bytes(allocated).c_str());
+  }
+  fs::remove_all(out_dir);
+}
+
+std::uint64_t arg_or(const cli::ParseResult& result, const char* flag,
+                     std::uint64_t fallback) {
+  std::uint64_t value = result.get<std::uint64_t>(flag).value_or(0);
+  return value > 0 ? value : fallback;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  cli::CliExecutor executor("bench_cp_file",
+                            "Compare copy strategies on synthetic workloads");
+  executor.set_usage("[options]");
+
+  executor.add_flag("--dir", cli::FlagType::MultiArg,
+                    "Fixture directory (tmpfs or local disk; default /tmp)");
+  executor.add_flag("--huge-mb", cli::FlagType::UInt64,
+                    "Size of the single huge file in MiB (default 1024)");
+  executor.add_flag("--tiny-count", cli::FlagType::UInt64,
+                    "Number of 4 KiB files (default 100000)");
+  executor.add_flag("--sparse-mb", cli::FlagType::UInt64,
+                    "Apparent size of the sparse file in MiB (default 1024)");
+  executor.add_flag("--workload", cli::FlagType::MultiArg,
+                    "Run only huge, tiny or sparse");
+  executor.add_flag("--strategy", cli::FlagType::MultiArg,
+                    "Run only the named strategy");
+
+  executor.set_handler([](const cli::ParseResult& result) {
+    auto dir_args = result.get_args("--dir");
+    fs::path root = fs::path(dir_args.empty() ? "/tmp" : dir_args[0]) /
+                    ("bench_cp_file." + std::to_string(::getpid()));
+    auto workload_args = result.get_args("--workload");
+    auto strategy_args = result.get_args("--strategy");
+    std::string only_workload = workload_args.empty() ? "" : workload_args[0];
+    std::string only_strategy = strategy_args.empty() ? "" : strategy_args[0];
+
+    std::error_code ec;
+    fs::create_directories(root / "src", ec);
+    if (ec) {
+      std::fprintf(stderr, "Error: Cannot create fixture %s: %s\n",
+                   root.c_str(), ec.message().c_str());
+      return 1;
+    }
+
+    std::vector<Workload> workloads;
+    if (only_workload.empty() || only_workload == "huge") {
+      Workload w{"huge", {}, arg_or(result, "--huge-mb", 1024) << 20};
+      w.files.push_back((root / "src" / "huge.bin").string());
+      if (!write_pattern(w.files[0], w.bytes)) {
+        std::fprintf(stderr, "Error: Cannot create huge source file\n");
+        return 1;
+      }
+      workloads.push_back(std::move(w));
+    }
+    if (only_workload.empty() || only_workload == "tiny") {
+      Workload w{"tiny", {}, 0};
+      fs::create_directories(root / "src" / "tiny");
+      std::uint64_t count = arg_or(result, "--tiny-count", 100000);
+      for (std::uint64_t i = 0; i < count; ++i) {
+        w.files.push_back((root / "src" / "tiny" / std::to_string(i)).string());
+        if (!write_pattern(w.files.back(), 4096)) {
+          std::fprintf(stderr, "Error: Cannot create tiny source files\n");
+          return 1;
+        }
+        w.bytes += 4096;
+      }
+      workloads.push_back(std::move(w));
+    }
+    if (only_workload.empty() || only_workload == "sparse") {
+      Workload w{"sparse", {}, arg_or(result, "--sparse-mb", 1024) << 20};
+      w.files.push_back((root / "src" / "sparse.bin").string());
+      if (!write_sparse(w.files[0], w.bytes)) {
+        std::fprintf(stderr, "Error: Cannot create sparse source file\n");
+        return 1;
+      }
+      workloads.push_back(std::move(w));
+    }
+
+    // MB/s counts apparent bytes; "allocated" shows whether holes survived
+    std::printf("%-8s %-16s %10s %10s %12s %12s\n", "workload", "strategy",
+                "seconds", "MB/s", "syscalls/f", "allocated");
+    for (const auto& workload : workloads) {
+      run_workload(workload, root / "out", only_strategy);
+    }
+
+    fs::remove_all(root, ec);
+    return 0;
+  });
+
+  return executor.run(argc, argv);
+}
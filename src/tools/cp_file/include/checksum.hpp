@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CP_FILE_HAVE_HW_CRC32C 1
+#endif
+
+namespace cp_file {
+
+namespace detail {
+
+/// Lookup table for the reflected CRC-32C (Castagnoli) polynomial
+inline const std::array<std::uint32_t, 256>& crc32c_table() {
+  static const std::array<std::uint32_t, 256> table = [] {
+    std::array<std::uint32_t, 256> t{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ ((crc & 1u) ? 0x82F63B78u : 0u);
+      }
+      t[i] = crc;
+    }
+    return t;
+  }();
+  return table;
+}
+
+/// Table-driven CRC-32C, one byte at a time
+inline std::uint32_t crc32c_sw(const unsigned char* p, std::size_t size,
+                               std::uint32_t crc) {
+  const auto& table = crc32c_table();
+  for (std::size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ p[i]) & 0xFFu] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef CP_FILE_HAVE_HW_CRC32C
+/// CRC-32C using the SSE4.2 crc32 instruction, eight bytes at a time
+__attribute__((target("sse4.2"))) inline std::uint32_t crc32c_hw(
+    const unsigned char* p, std::size_t size, std::uint32_t crc) {
+  std::uint64_t crc64 = crc;
+  while (size >= 8) {
+    std::uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    p += 8;
+    size -= 8;
+  }
+  crc = static_cast<std::uint32_t>(crc64);
+  while (size > 0) {
+    crc = _mm_crc32_u8(crc, *p);
+    ++p;
+    --size;
+  }
+  return crc;
+}
+
+/// Whether the running CPU supports SSE4.2 (checked once)
+inline bool have_hw_crc32c() {
+  static const bool supported = __builtin_cpu_supports("sse4.2");
+  return supported;
+}
+#endif
+
+}  // namespace detail
+
+/// Compute (or continue) a CRC-32C checksum over a buffer.
+/// Uses the hardware crc32 instruction when the CPU has it.
+/// @param data Bytes to checksum
+/// @param size Number of bytes
+/// @param crc Previous checksum when hashing a stream in pieces (0 to start)
+/// @return Updated checksum
+inline std::uint32_t crc32c(const void* data, std::size_t size,
+                            std::uint32_t crc = 0) {
+  const auto* p = static_cast<const unsigned char*>(data);
+#ifdef CP_FILE_HAVE_HW_CRC32C
+  if (detail::have_hw_crc32c()) {
+    return ~detail::crc32c_hw(p, size, ~crc);
+  }
+#endif
+  return ~detail::crc32c_sw(p, size, ~crc);
+}
+
+}  // namespace cp_file
@@ -1,74 +1,498 @@
 #pragma once
 
-#include <filesystem>
-#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
 #include <string>
 
+#include "dedup.hpp"
+#include "delta.hpp"
+#include "dir_cache.hpp"
+#include "direct.hpp"
+#include "durability.hpp"
+#include "posix_io.hpp"
+#include "progress.hpp"
+#include "resume.hpp"
+#include "sync.hpp"
+#include "throttle.hpp"
+#include "verify.hpp"
+
 namespace cp_file {
 
+/// Size of the buffer used by the read/write copy loop
+constexpr std::size_t kCopyBufferSize = 1 << 20;
+
 /// Result of a copy operation
 struct CopyResult {
   bool success = false;
   std::string error_message;
   std::size_t bytes_copied = 0;
+  std::size_t resumed_from = 0;  // Offset the copy continued from (resume)
+  bool skipped = false;          // Destination was already up to date
+  std::size_t bytes_reused = 0;  // Unchanged bytes left in place (delta)
+  bool verified = false;         // Destination re-read and checksum matched
 };
 
+/// Options controlling a copy operation
+struct CopyOptions {
+  bool overwrite = false;        // Overwrite existing destination file
+  Progress* progress = nullptr;  // Optional progress counters to update
+  bool resume = false;           // Continue a partial destination
+  bool verify_prefix = false;    // Check sampled blocks before resuming
+  bool update = false;           // Skip files whose destination is current
+  bool compare_content = false;  // With update, compare contents not mtime
+  bool delta = false;            // Rewrite only blocks that differ
+  bool verify = false;           // Checksum and re-read the destination
+  bool direct = false;           // Keep the copy out of the page cache
+  Durability durability = Durability::None;  // Crash-safety policy
+  DurabilityBatch* batch = nullptr;  // Defers Fsync work to one commit
+  DirectoryCache* dirs = nullptr;    // Shared cache of destination dirs
+  DedupMode dedup = DedupMode::None;  // Link identical files (copy_tree)
+  Throttle* throttle = nullptr;      // Shared bandwidth/IOPS limits
+};
+
+namespace detail {
+
+/// Per-file state used by the copy loop
+struct CopyLoop {
+  int in_fd = -1;
+  int out_fd = -1;
+  std::uint64_t position = 0;          // Current offset of both descriptors
+  Progress* progress = nullptr;        // Advanced after every chunk
+  ResumeJournal* journal = nullptr;    // Committed every kJournalCommitInterval
+  ChecksumPipeline* hasher = nullptr;  // Supplies buffers, hashes each chunk
+  CacheDropper* dropper = nullptr;     // Drops cached pages behind the cursor
+  Throttle* throttle = nullptr;        // Paces each chunk (read + write)
+  bool direct = false;                 // Descriptors use O_DIRECT
+};
+
+/// Copy all remaining bytes from in_fd to out_fd through a user-space buffer
+/// @return true on success; on failure error_message is filled in
+inline bool copy_fd_contents(CopyLoop& loop, const std::string& source,
+                             const std::string& dest, CopyResult& result) {
+  AlignedBuffer own_buffer;
+  if (!loop.hasher) {
+    own_buffer = make_aligned_buffer(kCopyBufferSize);
+  }
+  auto give_back = [&](char* buffer) {
+    if (loop.hasher) {
+      loop.hasher->release(buffer);
+    }
+  };
+
+  std::uint64_t uncommitted = 0;
+  for (;;) {
+    char* buffer = loop.hasher ? loop.hasher->acquire() : own_buffer.get();
+    ssize_t n = ::read(loop.in_fd, buffer, kCopyBufferSize);
+    if (n < 0) {
+      give_back(buffer);
+      if (errno == EINTR) {
+        continue;
+      }
+      result.error_message = errno_message("Failed to read", source, errno);
+      return false;
+    }
+    if (n == 0) {
+      give_back(buffer);
+      if (loop.dropper) {
+        loop.dropper->finish(loop.position);
+      }
+      return true;
+    }
+
+    // The whole chunk is charged at once, so throttling never shrinks I/O
+    if (loop.throttle) {
+      loop.throttle->acquire(static_cast<std::uint64_t>(n), 2);
+    }
+
+    // O_DIRECT needs aligned lengths and offsets; the tail of the file is
+    // written through the page cache instead
+    if (loop.direct && static_cast<std::size_t>(n) % kIoAlignment != 0) {
+      clear_direct(loop.in_fd);
+      clear_direct(loop.out_fd);
+      loop.direct = false;
+    }
+
+    if (!write_all(loop.out_fd, buffer, static_cast<std::size_t>(n))) {
+      give_back(buffer);
+      result.error_message = errno_message("Failed to write", dest, errno);
+      return false;
+    }
+    if (loop.hasher) {
+      loop.hasher->submit(buffer, static_cast<std::size_t>(n));
+    }
+    result.bytes_copied += static_cast<std::size_t>(n);
+    if (loop.progress) {
+      loop.progress->add_bytes(static_cast<std::uint64_t>(n));
+    }
+
+    loop.position += static_cast<std::uint64_t>(n);
+    if (loop.dropper) {
+      loop.dropper->advance(loop.position);
+    }
+
+    uncommitted += static_cast<std::uint64_t>(n);
+    if (loop.journal && uncommitted >= kJournalCommitInterval) {
+      if (::fdatasync(loop.out_fd) != 0 ||
+          !loop.journal->commit(loop.position)) {
+        result.error_message =
+            errno_message("Failed to commit checkpoint", dest, errno);
+        return false;
+      }
+      uncommitted = 0;
+    }
+  }
+}
+
+/// Work out where a resumed copy should start, truncate the destination to
+/// that point and position both descriptors there
+/// @param offset Receives the offset the copy continues from
+/// @return true on success; on failure error_message is filled in
+inline bool prepare_resume(int in_fd, int out_fd, const struct stat& src_st,
+                           const std::string& dest, const CopyOptions& options,
+                           ResumeJournal& journal, std::uint64_t& offset,
+                           CopyResult& result) {
+  struct stat dst_st;
+  if (::fstat(out_fd, &dst_st) != 0) {
+    result.error_message =
+        errno_message("Failed to stat destination", dest, errno);
+    return false;
+  }
+
+  auto id = SourceIdentity::from_stat(src_st);
+  auto journal_path = ResumeJournal::path_for(dest);
+  auto dst_size = static_cast<std::uint64_t>(dst_st.st_size);
+
+  std::uint64_t committed = 0;
+  switch (ResumeJournal::load(journal_path, id, committed)) {
+    case JournalStatus::Valid:
+      offset = std::min(committed, dst_size);
+      break;
+    case JournalStatus::Missing:
+      // No checkpoint: trust the existing length, minus any torn tail
+      offset = dst_size - dst_size % kResumeAlignment;
+      break;
+    case JournalStatus::Stale:
+      // Source changed since the journal was written; start over
+      offset = 0;
+      break;
+  }
+  if (offset > id.size) {
+    offset = 0;
+  }
+
+  if (options.verify_prefix) {
+    offset = verify_prefix(in_fd, out_fd, offset);
+  }
+
+  if (::ftruncate(out_fd, static_cast<off_t>(offset)) != 0 ||
+      ::lseek(in_fd, static_cast<off_t>(offset), SEEK_SET) < 0 ||
+      ::lseek(out_fd, static_cast<off_t>(offset), SEEK_SET) < 0) {
+    result.error_message =
+        errno_message("Failed to position for resume", dest, errno);
+    return false;
+  }
+
+  if (!journal.open(journal_path, id, offset)) {
+    result.error_message =
+        errno_message("Failed to create journal", journal_path, errno);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace detail
+
 /// Copy a file from source to destination
 /// @param source Source file path
 /// @param dest Destination file path
-/// @param overwrite If true, overwrite existing destination file
+/// @param options Copy options (overwrite, progress, resume, update, delta,
+///                verify, direct, durability)
 /// @return CopyResult with status and bytes copied
 inline CopyResult copy_file(const std::string& source, const std::string& dest,
-                            bool overwrite = false) {
+                            const CopyOptions& options) {
   CopyResult result;
 
-  namespace fs = std::filesystem;
-
-  // Check source exists
-  if (!fs::exists(source)) {
-    result.error_message = "Source file does not exist: " + source;
+  // Every attempted file reaches end_file, including one that fails before
+  // any data moves
+  bool progress_begun = false;
+  auto finish = [&]() -> CopyResult& {
+    if (options.progress && !result.skipped) {
+      if (!progress_begun) {
+        options.progress->begin_file(0);
+      }
+      options.progress->end_file(result.success);
+    }
     return result;
+  };
+
+  // Resume takes precedence over delta: it already skips the copied prefix
+  bool use_delta = options.delta && !options.resume;
+
+  // Direct I/O needs aligned buffers, which the delta loop does not use
+  bool want_direct = options.direct && !use_delta;
+  bool in_direct = false;
+  bool out_direct = false;
+
+  // Everything about the source comes from one open and one fstat rather
+  // than separate exists/is_regular_file lookups. O_NONBLOCK keeps a FIFO
+  // from blocking the open; it has no effect on regular files.
+  detail::UniqueFd in_fd(open_maybe_direct(
+      AT_FDCWD, source.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC, 0,
+      want_direct, in_direct));
+  if (!in_fd.valid()) {
+    result.error_message =
+        errno == ENOENT
+            ? "Source file does not exist: " + source
+            : detail::errno_message("Failed to open source", source, errno);
+    return finish();
   }
 
-  // Check source is a regular file
-  if (!fs::is_regular_file(source)) {
+  struct stat st;
+  if (::fstat(in_fd.get(), &st) != 0) {
+    result.error_message =
+        detail::errno_message("Failed to stat source", source, errno);
+    return finish();
+  }
+  if (!S_ISREG(st.st_mode)) {
     result.error_message = "Source is not a regular file: " + source;
+    return finish();
+  }
+
+  // Incremental mode: an unchanged destination costs one more statx
+  if (options.update &&
+      is_up_to_date(source, FileMeta::from_stat(st), dest,
+                    options.compare_content)) {
+    result.success = true;
+    result.skipped = true;
     return result;
   }
 
-  // Check destination doesn't exist (unless overwrite)
-  if (fs::exists(dest) && !overwrite) {
+  // The destination is created relative to its (cached) parent directory,
+  // so repeated copies into one directory do not re-resolve its path
+  std::string dest_dir;
+  std::string dest_name;
+  split_path(dest, dest_dir, dest_name);
+  DirectoryCache local_dirs(1);
+  DirHandle dir = (options.dirs ? options.dirs : &local_dirs)->open(dest_dir);
+  if (!dir) {
+    result.error_message = detail::errno_message(
+        "Failed to create destination directory", dest_dir, errno);
+    return finish();
+  }
+
+  // Overwrite, resume, update and delta all work on an existing destination;
+  // otherwise O_EXCL refuses it without a separate (racy) existence check
+  bool replace_ok = options.overwrite || options.resume || options.update ||
+                    options.delta;
+
+  // A full rewrite under Atomic/Fsync goes to a temp file that is renamed
+  // into place. Resume and delta exist to modify the destination in place,
+  // so they only get the fdatasync part of Fsync.
+  bool use_temp = options.durability != Durability::None && !use_delta &&
+                  !options.resume;
+  std::string write_name = use_temp ? make_temp_name(dest_name) : dest_name;
+  if (use_temp && !replace_ok &&
+      ::faccessat(dir->get(), dest_name.c_str(), F_OK,
+                  AT_SYMLINK_NOFOLLOW) == 0) {
     result.error_message = "Destination already exists: " + dest;
-    return result;
+    return finish();
+  }
+
+  // Delta and verify read the destination back, so they need O_RDWR
+  int open_flags = O_CREAT | O_CLOEXEC;
+  open_flags |= (use_delta || options.verify) ? O_RDWR : O_WRONLY;
+  if (use_temp || !replace_ok) {
+    open_flags |= O_EXCL;
+  } else if (!use_delta && !options.resume) {
+    open_flags |= O_TRUNC;
   }
+  detail::UniqueFd out_fd(open_maybe_direct(dir->get(), write_name.c_str(),
+                                            open_flags, st.st_mode & 07777,
+                                            want_direct, out_direct));
+  if (!out_fd.valid()) {
+    result.error_message =
+        errno == EEXIST && !use_temp
+            ? "Destination already exists: " + dest
+            : detail::errno_message("Failed to open destination", dest, errno);
+    return finish();
+  }
+  TempFileGuard temp_guard(dir->get(), use_temp ? write_name : std::string());
 
-  // Create destination directory if needed
-  fs::path dest_path(dest);
-  if (dest_path.has_parent_path()) {
-    std::error_code ec;
-    fs::create_directories(dest_path.parent_path(), ec);
-    if (ec) {
+  ResumeJournal journal;
+  std::uint64_t offset = 0;
+  if (options.resume) {
+    if (!detail::prepare_resume(in_fd.get(), out_fd.get(), st, dest, options,
+                                journal, offset, result)) {
+      return finish();
+    }
+    result.resumed_from = static_cast<std::size_t>(offset);
+  }
+
+  // Delta rewrites blocks that are already allocated, so only full and
+  // resumed copies reserve the rest of the file up front
+  auto src_size = static_cast<std::uint64_t>(st.st_size);
+  if (!use_delta && src_size > offset &&
+      !detail::preallocate(out_fd.get(), offset, src_size - offset)) {
+    result.error_message = detail::errno_message(
+        "Not enough space for destination", dest, errno);
+    return finish();
+  }
+
+  if (options.progress) {
+    options.progress->begin_file(src_size - offset);
+    progress_begun = true;
+  }
+
+  std::unique_ptr<ChecksumPipeline> hasher;
+  if (options.verify && !use_delta) {
+    hasher = std::make_unique<ChecksumPipeline>(kCopyBufferSize);
+  }
+
+  if (use_delta) {
+    DeltaStats stats;
+    result.success =
+        delta_update(in_fd.get(), out_fd.get(),
+                     static_cast<std::uint64_t>(st.st_size), options.progress,
+                     stats, options.throttle);
+    if (!result.success) {
       result.error_message =
-          "Failed to create destination directory: " + ec.message();
-      return result;
+          detail::errno_message("Failed to update destination", dest, errno);
+    }
+    result.bytes_copied = static_cast<std::size_t>(stats.bytes_written);
+    result.bytes_reused = static_cast<std::size_t>(stats.bytes_reused);
+  } else {
+    detail::CopyLoop loop;
+    loop.in_fd = in_fd.get();
+    loop.out_fd = out_fd.get();
+    loop.position = offset;
+    loop.progress = options.progress;
+    loop.journal = journal.is_open() ? &journal : nullptr;
+    loop.hasher = hasher.get();
+    loop.throttle = options.throttle;
+
+    // Both ends must be direct for aligned transfers; otherwise fall back to
+    // dropping cached pages behind the cursor
+    std::unique_ptr<CacheDropper> dropper;
+    if (options.direct) {
+      loop.direct = in_direct && out_direct;
+      if (!loop.direct) {
+        if (in_direct) {
+          clear_direct(in_fd.get());
+        }
+        if (out_direct) {
+          clear_direct(out_fd.get());
+        }
+      }
+      dropper =
+          std::make_unique<CacheDropper>(in_fd.get(), out_fd.get(), offset);
+      loop.dropper = dropper.get();
+    }
+
+    result.success = detail::copy_fd_contents(loop, source, dest, result);
+
+    // The source shrank while being copied: release the blocks reserved
+    // past the new end
+    if (result.success && loop.position < src_size) {
+      ::ftruncate(out_fd.get(), static_cast<off_t>(loop.position));
     }
   }
 
-  // Perform copy
-  try {
-    auto options = fs::copy_options::none;
-    if (overwrite) {
-      options = fs::copy_options::overwrite_existing;
+  // Compare the checksum of the bytes that went through the copy buffer
+  // with the destination as read back from disk. A delta update never
+  // streams the whole source through one buffer, so it re-reads the source.
+  if (result.success && options.verify) {
+    std::uint32_t expected = 0;
+    std::uint32_t actual = 0;
+    std::uint64_t verify_from = use_delta ? 0 : offset;
+    if (hasher) {
+      expected = hasher->finish();
+    } else if (!checksum_fd(in_fd.get(), 0, expected)) {
+      result.success = false;
+      result.error_message =
+          detail::errno_message("Failed to read", source, errno);
+    }
+    if (result.success &&
+        !checksum_from_disk(out_fd.get(), verify_from, actual)) {
+      result.success = false;
+      result.error_message =
+          detail::errno_message("Failed to read back", dest, errno);
+    } else if (result.success && expected != actual) {
+      result.success = false;
+      result.error_message = "Verification failed: checksum mismatch: " + dest;
     }
+    result.verified = result.success;
+  }
 
-    fs::copy_file(source, dest, options);
-    result.success = true;
-    result.bytes_copied = fs::file_size(dest);
-  } catch (const fs::filesystem_error& e) {
-    result.error_message = e.what();
+  // Carry the source mtime over so the next update run can skip this file
+  if (result.success && options.update &&
+      !set_mtime(out_fd.get(), st.st_mtim.tv_sec,
+                 static_cast<std::uint32_t>(st.st_mtim.tv_nsec))) {
+    result.success = false;
+    result.error_message =
+        detail::errno_message("Failed to set modification time", dest, errno);
+  }
+
+  // Without a batch, Fsync pays for durability per file
+  bool sync_now = options.durability == Durability::Fsync &&
+                  (!use_temp || options.batch == nullptr);
+  if (result.success && sync_now && ::fdatasync(out_fd.get()) != 0) {
+    result.success = false;
+    result.error_message =
+        detail::errno_message("Failed to sync destination", dest, errno);
+  }
+
+  if (result.success && ::close(out_fd.release()) != 0) {
+    result.success = false;
+    result.error_message =
+        detail::errno_message("Failed to close destination", dest, errno);
+  }
+
+  if (result.success && use_temp) {
+    if (options.durability == Durability::Fsync && options.batch) {
+      options.batch->add_rename(
+          dest.substr(0, dest.size() - dest_name.size()) + write_name, dest,
+          replace_ok);
+      temp_guard.dismiss();
+    } else if (!rename_into_place(dir->get(), write_name, dir->get(),
+                                  dest_name, replace_ok)) {
+      result.success = false;
+      result.error_message =
+          errno == EEXIST
+              ? "Destination already exists: " + dest
+              : detail::errno_message("Failed to rename into place", dest,
+                                      errno);
+    } else {
+      temp_guard.dismiss();
+      if (sync_now && ::fsync(dir->get()) != 0) {
+        result.success = false;
+        result.error_message = detail::errno_message(
+            "Failed to sync directory", dest_dir, errno);
+      }
+    }
+  }
+
+  if (result.success && journal.is_open()) {
+    journal.remove();
   }
 
-  return result;
+  return finish();
+}
+
+/// Copy a file from source to destination
+/// @param source Source file path
+/// @param dest Destination file path
+/// @param overwrite If true, overwrite existing destination file
+/// @return CopyResult with status and bytes copied
+inline CopyResult copy_file(const std::string& source, const std::string& dest,
+                            bool overwrite = false) {
+  CopyOptions options;
+  options.overwrite = overwrite;
+  return copy_file(source, dest, options);
 }
 
 }  // namespace cp_file
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "checksum.hpp"
+#include "dir_cache.hpp"
+#include "durability.hpp"
+#include "posix_io.hpp"
+#include "sync.hpp"
+#include "verify.hpp"
+
+namespace cp_file {
+
+/// How duplicate files in a tree are written
+enum class DedupMode {
+  None,     // Copy every file
+  Reflink,  // Share extents with the first copy (FICLONE), else copy
+  Hardlink  // Hard link to the first copy
+};
+
+/// Find byte-identical files. Files are grouped by size first, so only
+/// size collisions are read at all; those are grouped by CRC-32C, and a
+/// checksum match is confirmed with a byte comparison before it counts.
+/// Empty files are never treated as duplicates.
+/// @return For each file, the index of the first identical file (itself if
+///         it has no earlier duplicate)
+inline std::vector<std::size_t> find_duplicates(
+    const std::vector<std::string>& paths,
+    const std::vector<std::uint64_t>& sizes) {
+  std::vector<std::size_t> canonical(paths.size());
+  std::unordered_map<std::uint64_t, std::vector<std::size_t>> by_size;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    canonical[i] = i;
+    if (sizes[i] > 0) {
+      by_size[sizes[i]].push_back(i);
+    }
+  }
+
+  for (const auto& [size, group] : by_size) {
+    if (group.size() < 2) {
+      continue;
+    }
+    // Ordered so that the lowest index in each checksum group comes first
+    std::map<std::uint32_t, std::vector<std::size_t>> by_crc;
+    for (std::size_t i : group) {
+      std::uint32_t crc = 0;
+      if (file_checksum(paths[i], crc)) {
+        by_crc[crc].push_back(i);
+      }
+    }
+    for (const auto& [crc, candidates] : by_crc) {
+      // Compare each file against the canonical copies found so far
+      std::vector<std::size_t> originals;
+      for (std::size_t i : candidates) {
+        for (std::size_t original : originals) {
+          if (files_identical(paths[original], paths[i], size)) {
+            canonical[i] = original;
+            break;
+          }
+        }
+        if (canonical[i] == i) {
+          originals.push_back(i);
+        }
+      }
+    }
+  }
+  return canonical;
+}
+
+/// Result of writing one duplicate
+enum class LinkStatus {
+  Linked,       // dest now shares the existing copy's data
+  Unsupported,  // Reflink not possible here; copy the file instead
+  Failed        // errno describes the failure
+};
+
+/// Make dest a hard link or reflink of existing, a completed copy of the
+/// same content. dest is built under a temp name and renamed into place,
+/// so a crash never leaves a half-written duplicate.
+/// @param replace Whether an existing dest may be replaced
+/// @param st Stat of the source file (mode and mtime for reflinks)
+inline LinkStatus link_duplicate(const std::string& existing,
+                                 const std::string& dest, DedupMode mode,
+                                 bool replace, bool keep_mtime, bool sync,
+                                 const struct stat& st, DirectoryCache& dirs) {
+  std::string dest_dir;
+  std::string dest_name;
+  split_path(dest, dest_dir, dest_name);
+  DirHandle dir = dirs.open(dest_dir);
+  if (!dir) {
+    return LinkStatus::Failed;
+  }
+
+  std::string temp_name = make_temp_name(dest_name);
+  TempFileGuard guard(dir->get(), temp_name);
+  if (mode == DedupMode::Hardlink) {
+    if (::linkat(AT_FDCWD, existing.c_str(), dir->get(), temp_name.c_str(),
+                 0) != 0) {
+      guard.dismiss();
+      return LinkStatus::Failed;
+    }
+  } else {
+    detail::UniqueFd in_fd(::open(existing.c_str(), O_RDONLY | O_CLOEXEC));
+    detail::UniqueFd out_fd(
+        ::openat(dir->get(), temp_name.c_str(),
+                 O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777));
+    if (!in_fd.valid() || !out_fd.valid()) {
+      if (!out_fd.valid()) {
+        guard.dismiss();
+      }
+      return LinkStatus::Failed;
+    }
+    if (::ioctl(out_fd.get(), FICLONE, in_fd.get()) != 0) {
+      int err = errno;
+      if (err == EOPNOTSUPP || err == EXDEV || err == EINVAL ||
+          err == ENOTTY) {
+        return LinkStatus::Unsupported;
+      }
+      errno = err;
+      return LinkStatus::Failed;
+    }
+    if ((keep_mtime &&
+         !set_mtime(out_fd.get(), st.st_mtim.tv_sec,
+                    static_cast<std::uint32_t>(st.st_mtim.tv_nsec))) ||
+        (sync && ::fdatasync(out_fd.get()) != 0) ||
+        ::close(out_fd.release()) != 0) {
+      return LinkStatus::Failed;
+    }
+  }
+
+  if (::renameat2(dir->get(), temp_name.c_str(), dir->get(),
+                  dest_name.c_str(), replace ? 0 : RENAME_NOREPLACE) != 0) {
+    return LinkStatus::Failed;
+  }
+  // Renaming one link of an inode over another link of it is a no-op that
+  // leaves the temp name in place; the guard removes it in that case
+  if (sync && ::fsync(dir->get()) != 0) {
+    return LinkStatus::Failed;
+  }
+  return LinkStatus::Linked;
+}
+
+}  // namespace cp_file
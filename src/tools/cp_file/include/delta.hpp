@@ -0,0 +1,127 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "posix_io.hpp"
+#include "progress.hpp"
+#include "throttle.hpp"
+
+namespace cp_file {
+
+/// Granularity at which unchanged destination data is kept
+constexpr std::size_t kDeltaBlockSize = 64 << 10;
+
+/// Bytes read per pass of the delta loop (a multiple of kDeltaBlockSize)
+constexpr std::size_t kDeltaChunkSize = 1 << 20;
+
+/// Outcome of a delta update
+struct DeltaStats {
+  std::uint64_t bytes_written = 0;  // Blocks that differed and were rewritten
+  std::uint64_t bytes_reused = 0;   // Blocks already identical in place
+};
+
+/// Update dst_fd in place so that it matches src_fd, writing only the blocks
+/// that differ. Both files are read once, sequentially; runs of adjacent
+/// differing blocks are coalesced into a single pwrite. The destination is
+/// truncated or extended to the source size.
+/// @param src_fd Source descriptor (read with pread)
+/// @param dst_fd Destination descriptor, opened read/write
+/// @param src_size Source size in bytes
+/// @param progress Optional counters, advanced by every block processed
+/// @param stats Receives written/reused byte counts
+/// @param throttle Optional limits, charged for every chunk read and run
+///                 written
+/// @return true on success, false with errno set on failure
+inline bool delta_update(int src_fd, int dst_fd, std::uint64_t src_size,
+                         Progress* progress, DeltaStats& stats,
+                         Throttle* throttle = nullptr) {
+  struct stat dst_st;
+  if (::fstat(dst_fd, &dst_st) != 0) {
+    return false;
+  }
+  auto dst_size = static_cast<std::uint64_t>(dst_st.st_size);
+
+  std::unique_ptr<char[]> src_buf(new char[kDeltaChunkSize]);
+  std::unique_ptr<char[]> dst_buf(new char[kDeltaChunkSize]);
+
+  for (std::uint64_t offset = 0; offset < src_size;
+       offset += kDeltaChunkSize) {
+    auto len = static_cast<std::size_t>(
+        std::min<std::uint64_t>(kDeltaChunkSize, src_size - offset));
+    if (!detail::pread_all(src_fd, src_buf.get(), len,
+                           static_cast<off_t>(offset))) {
+      return false;
+    }
+
+    // Bytes of this chunk that exist in the destination and can be compared
+    std::size_t comparable = 0;
+    if (dst_size > offset) {
+      comparable = static_cast<std::size_t>(
+          std::min<std::uint64_t>(len, dst_size - offset));
+      if (!detail::pread_all(dst_fd, dst_buf.get(), comparable,
+                             static_cast<off_t>(offset))) {
+        return false;
+      }
+    }
+    if (throttle) {
+      throttle->acquire(len, comparable > 0 ? 2 : 1);
+    }
+
+    std::size_t run_start = 0;
+    std::size_t run_len = 0;
+    auto flush_run = [&]() {
+      if (run_len == 0) {
+        return true;
+      }
+      if (throttle) {
+        throttle->acquire(0, 1);
+      }
+      if (!detail::pwrite_all(dst_fd, src_buf.get() + run_start, run_len,
+                              static_cast<off_t>(offset + run_start))) {
+        return false;
+      }
+      stats.bytes_written += run_len;
+      run_len = 0;
+      return true;
+    };
+
+    for (std::size_t pos = 0; pos < len; pos += kDeltaBlockSize) {
+      std::size_t block = std::min(kDeltaBlockSize, len - pos);
+      bool same = pos + block <= comparable &&
+                  std::memcmp(src_buf.get() + pos, dst_buf.get() + pos,
+                              block) == 0;
+      if (same) {
+        if (!flush_run()) {
+          return false;
+        }
+        stats.bytes_reused += block;
+      } else {
+        if (run_len == 0) {
+          run_start = pos;
+        }
+        run_len += block;
+      }
+    }
+    if (!flush_run()) {
+      return false;
+    }
+
+    if (progress) {
+      progress->add_bytes(len);
+    }
+  }
+
+  if (dst_size != src_size &&
+      ::ftruncate(dst_fd, static_cast<off_t>(src_size)) != 0) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace cp_file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "posix_io.hpp"
+
+namespace cp_file {
+
+/// Open directory descriptor shared between a cache and its users
+using DirHandle = std::shared_ptr<const detail::UniqueFd>;
+
+/// Split a path into its directory ("." if none) and final component
+inline void split_path(const std::string& path, std::string& dir,
+                       std::string& name) {
+  auto slash = path.find_last_of('/');
+  if (slash == std::string::npos) {
+    dir = ".";
+    name = path;
+  } else {
+    dir = slash == 0 ? "/" : path.substr(0, slash);
+    name = path.substr(slash + 1);
+  }
+}
+
+/// Keeps destination directories open so that files are created with
+/// openat() relative to a descriptor instead of re-walking the full path.
+/// A miss walks up to the nearest existing ancestor and creates the rest
+/// with mkdirat(); a hit costs no syscalls at all. Handles stay valid after
+/// eviction for as long as a caller holds them. Safe to share between
+/// copy workers.
+class DirectoryCache {
+ public:
+  explicit DirectoryCache(std::size_t capacity = 1024)
+      : capacity_(capacity) {}
+
+  /// Open (and if needed create) a directory
+  /// @return Handle, or nullptr with errno set
+  DirHandle open(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return open_locked(dir);
+  }
+
+ private:
+  DirHandle open_locked(const std::string& dir) {
+    auto it = dirs_.find(dir);
+    if (it != dirs_.end()) {
+      return it->second;
+    }
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT && dir != "." && dir != "/") {
+      fd = create(dir);
+    }
+    if (fd < 0) {
+      return nullptr;
+    }
+
+    if (dirs_.size() >= capacity_) {
+      dirs_.clear();
+    }
+    auto handle = std::make_shared<const detail::UniqueFd>(fd);
+    dirs_.emplace(dir, handle);
+    return handle;
+  }
+
+  /// Create dir below its (recursively opened) parent
+  int create(const std::string& dir) {
+    std::string parent;
+    std::string name;
+    split_path(dir, parent, name);
+    if (name.empty()) {
+      // Trailing slash: "a/b/" names the same directory as "a/b"
+      auto handle = open_locked(parent);
+      return handle ? ::fcntl(handle->get(), F_DUPFD_CLOEXEC, 0) : -1;
+    }
+
+    auto parent_handle = open_locked(parent);
+    if (!parent_handle) {
+      return -1;
+    }
+    if (::mkdirat(parent_handle->get(), name.c_str(), 0777) != 0 &&
+        errno != EEXIST) {
+      return -1;
+    }
+    return ::openat(parent_handle->get(), name.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }
+
+  std::size_t capacity_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, DirHandle> dirs_;
+};
+
+}  // namespace cp_file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstdint>
+
+namespace cp_file {
+
+/// Bytes between cache-drop points behind the copy cursor
+constexpr std::uint64_t kCacheDropWindow = 8ull << 20;
+
+/// Open a file with O_DIRECT if requested, falling back to a normal open
+/// when the filesystem rejects it (e.g. tmpfs returns EINVAL)
+/// @param dir_fd Directory that a relative path is resolved against
+/// @param is_direct Set to whether the returned descriptor uses O_DIRECT
+/// @return File descriptor, or -1 with errno set
+inline int open_maybe_direct(int dir_fd, const char* path, int flags,
+                             mode_t mode, bool want_direct, bool& is_direct) {
+  is_direct = false;
+  if (want_direct) {
+    int fd = ::openat(dir_fd, path, flags | O_DIRECT, mode);
+    if (fd >= 0) {
+      is_direct = true;
+      return fd;
+    }
+    if (errno != EINVAL) {
+      return -1;
+    }
+  }
+  return ::openat(dir_fd, path, flags, mode);
+}
+
+/// Switch a descriptor back to buffered I/O, used for the unaligned tail
+inline bool clear_direct(int fd) {
+  int flags = ::fcntl(fd, F_GETFL);
+  return flags >= 0 && ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+/// Keeps a copy from displacing the page cache. Source pages behind the
+/// read cursor are dropped straight away (they are clean). Destination
+/// pages are dirty, so each window is first pushed to writeback without
+/// waiting, and dropped one window later once that writeback has finished.
+/// The copy loop therefore rarely waits for the device. With O_DIRECT
+/// descriptors these calls find nothing cached and return immediately.
+class CacheDropper {
+ public:
+  CacheDropper(int in_fd, int out_fd, std::uint64_t start)
+      : in_fd_(in_fd), out_fd_(out_fd), window_start_(start) {
+    ::posix_fadvise(in_fd_, static_cast<off_t>(start), 0,
+                    POSIX_FADV_SEQUENTIAL);
+  }
+
+  /// Called after the cursor moved to position
+  void advance(std::uint64_t position) {
+    if (position - window_start_ < kCacheDropWindow) {
+      return;
+    }
+    std::uint64_t len = position - window_start_;
+    ::sync_file_range(out_fd_, static_cast<off_t>(window_start_),
+                      static_cast<off_t>(len), SYNC_FILE_RANGE_WRITE);
+    ::posix_fadvise(in_fd_, static_cast<off_t>(window_start_),
+                    static_cast<off_t>(len), POSIX_FADV_DONTNEED);
+    drop_written(prev_start_, prev_len_);
+
+    prev_start_ = window_start_;
+    prev_len_ = len;
+    window_start_ = position;
+  }
+
+  /// Called once the copy is complete to drop everything still cached
+  void finish(std::uint64_t position) {
+    std::uint64_t start = prev_len_ > 0 ? prev_start_ : window_start_;
+    ::posix_fadvise(in_fd_, static_cast<off_t>(window_start_),
+                    static_cast<off_t>(position - window_start_),
+                    POSIX_FADV_DONTNEED);
+    drop_written(start, position - start);
+    prev_len_ = 0;
+    window_start_ = position;
+  }
+
+ private:
+  void drop_written(std::uint64_t start, std::uint64_t len) {
+    if (len == 0) {
+      return;
+    }
+    ::sync_file_range(out_fd_, static_cast<off_t>(start),
+                      static_cast<off_t>(len),
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                          SYNC_FILE_RANGE_WAIT_AFTER);
+    ::posix_fadvise(out_fd_, static_cast<off_t>(start),
+                    static_cast<off_t>(len), POSIX_FADV_DONTNEED);
+  }
+
+  int in_fd_;
+  int out_fd_;
+  std::uint64_t window_start_;
+  std::uint64_t prev_start_ = 0;
+  std::uint64_t prev_len_ = 0;
+};
+
+}  // namespace cp_file
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dir_cache.hpp"
+#include "posix_io.hpp"
+
+namespace cp_file {
+
+/// How much crash safety a copy provides
+enum class Durability {
+  None,    // Write the destination in place; no syncs
+  Atomic,  // Write a temp file and rename it over the destination
+  Fsync    // Atomic, and data plus directory entries reach stable storage
+};
+
+/// Unique hidden temp name for a file: ".<name>.cp_file.<pid>.<n>"
+inline std::string make_temp_name(const std::string& name) {
+  static std::atomic<unsigned long> counter{0};
+  return "." + name + ".cp_file." + std::to_string(::getpid()) + "." +
+         std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+}
+
+/// Deletes a temp file in dir_fd when it goes out of scope, unless dismissed
+class TempFileGuard {
+ public:
+  TempFileGuard() = default;
+  TempFileGuard(int dir_fd, std::string name)
+      : dir_fd_(dir_fd), name_(std::move(name)) {}
+  ~TempFileGuard() {
+    if (!name_.empty()) {
+      ::unlinkat(dir_fd_, name_.c_str(), 0);
+    }
+  }
+
+  TempFileGuard(const TempFileGuard&) = delete;
+  TempFileGuard& operator=(const TempFileGuard&) = delete;
+
+  /// Keep the file (it was renamed or handed to a batch)
+  void dismiss() { name_.clear(); }
+
+ private:
+  int dir_fd_ = AT_FDCWD;
+  std::string name_;
+};
+
+/// Move a finished temp file to its final name. Unless replace is set, an
+/// existing file there (e.g. one created concurrently) is left alone and
+/// the rename fails with EEXIST.
+inline bool rename_into_place(int from_dir, const std::string& from,
+                              int to_dir, const std::string& to,
+                              bool replace) {
+  return ::renameat2(from_dir, from.c_str(), to_dir, to.c_str(),
+                     replace ? 0 : RENAME_NOREPLACE) == 0;
+}
+
+/// fsync a directory so that renames and new entries in it are durable
+inline bool fsync_directory(const std::string& dir) {
+  detail::UniqueFd fd(
+      ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  return fd.valid() && ::fsync(fd.get()) == 0;
+}
+
+/// Defers the expensive part of Durability::Fsync to the end of a
+/// multi-file copy. Instead of fdatasync per file, rename, fsync(dir):
+/// temp files are written unsynced, then commit() issues one syncfs per
+/// filesystem they are on, performs all renames, and fsyncs each touched
+/// directory once. add_rename() may be called from several copy workers
+/// at once.
+class DurabilityBatch {
+ public:
+  /// Record a completed temp file that should replace final_path
+  /// @param replace Whether an existing final_path may be replaced
+  void add_rename(std::string temp_path, std::string final_path,
+                  bool replace) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    renames_.push_back({std::move(temp_path), std::move(final_path), replace});
+  }
+
+  std::size_t pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return renames_.size();
+  }
+
+  /// Make every recorded file durable and move it into place
+  /// @param errors Receives one message per failure
+  /// @return Number of files that could not be moved into place
+  std::size_t commit(std::vector<std::string>& errors) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (renames_.empty()) {
+      return 0;
+    }
+
+    // A tree may span mount points: syncfs each filesystem that holds a
+    // temp file, once
+    std::map<dev_t, bool> synced;
+    std::vector<dev_t> devices(renames_.size());
+    std::vector<bool> located(renames_.size());
+    for (std::size_t i = 0; i < renames_.size(); ++i) {
+      struct stat st;
+      located[i] = ::stat(renames_[i].temp_path.c_str(), &st) == 0;
+      if (!located[i]) {
+        errors.push_back(detail::errno_message(
+            "Failed to stat", renames_[i].temp_path, errno));
+        continue;
+      }
+      devices[i] = st.st_dev;
+      if (synced.count(st.st_dev) != 0) {
+        continue;
+      }
+      std::string dir;
+      std::string name;
+      split_path(renames_[i].temp_path, dir, name);
+      detail::UniqueFd fs_fd(
+          ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+      bool ok = fs_fd.valid() && ::syncfs(fs_fd.get()) == 0;
+      if (!ok) {
+        errors.push_back(
+            detail::errno_message("Failed to sync filesystem", dir, errno));
+      }
+      synced[st.st_dev] = ok;
+    }
+
+    // Never expose a file whose data may not be on disk
+    std::size_t failed = 0;
+    std::set<std::string> directories;
+    for (std::size_t i = 0; i < renames_.size(); ++i) {
+      const Rename& rename = renames_[i];
+      if (!located[i] || !synced[devices[i]]) {
+        ::unlink(rename.temp_path.c_str());
+        ++failed;
+        continue;
+      }
+      if (!rename_into_place(AT_FDCWD, rename.temp_path, AT_FDCWD,
+                             rename.final_path, rename.replace)) {
+        errors.push_back(
+            errno == EEXIST
+                ? "Destination already exists: " + rename.final_path
+                : detail::errno_message("Failed to rename", rename.final_path,
+                                        errno));
+        ::unlink(rename.temp_path.c_str());
+        ++failed;
+        continue;
+      }
+      std::string dir;
+      std::string name;
+      split_path(rename.final_path, dir, name);
+      directories.insert(std::move(dir));
+    }
+    renames_.clear();
+
+    for (const auto& dir : directories) {
+      if (!fsync_directory(dir)) {
+        errors.push_back(
+            detail::errno_message("Failed to sync directory", dir, errno));
+      }
+    }
+    return failed;
+  }
+
+ private:
+  struct Rename {
+    std::string temp_path;
+    std::string final_path;
+    bool replace;
+  };
+
+  mutable std::mutex mutex_;
+  std::vector<Rename> renames_;
+};
+
+}  // namespace cp_file
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+#include "cp_file.hpp"
+#include "parallel.hpp"
+#include "stdin_reader.hpp"
+
+namespace cp_file {
+
+/// Aggregate result of a manifest run
+struct ManifestResult {
+  bool success = false;  // True if the manifest was read and no entry failed
+  std::string error_message;  // Set if the manifest itself cannot be read
+  std::size_t entries = 0;
+  std::size_t files_copied = 0;
+  std::size_t files_skipped = 0;
+  std::size_t files_failed = 0;
+  std::size_t bytes_copied = 0;
+};
+
+/// Split a manifest line of the form "source<TAB>dest"
+/// @return false unless the line has exactly two non-empty fields
+inline bool parse_manifest_line(const std::string& line, std::string& source,
+                                std::string& dest) {
+  auto tab = line.find('\t');
+  if (tab == std::string::npos || tab == 0 ||
+      line.find('\t', tab + 1) != std::string::npos) {
+    return false;
+  }
+  source = line.substr(0, tab);
+  dest = line.substr(tab + 1);
+  if (!dest.empty() && dest.back() == '\r') {
+    dest.pop_back();
+  }
+  return !dest.empty();
+}
+
+namespace detail {
+
+/// Replace tabs and newlines so a message stays inside one log field
+inline std::string log_field(std::string text) {
+  for (char& c : text) {
+    if (c == '\t' || c == '\n' || c == '\r') {
+      c = ' ';
+    }
+  }
+  return text;
+}
+
+/// Write one result record:
+/// "<line>\t<ok|skipped|failed>\t<bytes>\t<source>\t<dest>\t<error>"
+inline void write_log_record(std::FILE* log, std::size_t line,
+                             const char* status, std::size_t bytes,
+                             const std::string& source,
+                             const std::string& dest,
+                             const std::string& error) {
+  if (!log) {
+    return;
+  }
+  std::fprintf(log, "%zu\t%s\t%zu\t%s\t%s\t%s\n", line, status, bytes,
+               source.c_str(), dest.c_str(), log_field(error).c_str());
+}
+
+}  // namespace detail
+
+/// Copy every "source<TAB>dest" pair listed in a manifest. Lines are
+/// streamed (never loaded all at once) into a CopyPool, so one process
+/// handles any number of entries. Blank lines and lines starting with '#'
+/// are ignored. Each entry gets one record in the result log, in completion
+/// order, keyed by its manifest line number.
+/// @param manifest Manifest file path, or "-" for stdin
+/// @param options Options applied to every copy
+/// @param jobs Number of parallel copy workers
+/// @param log Destination of the result log (may be nullptr)
+inline ManifestResult copy_manifest(const std::string& manifest,
+                                    const CopyOptions& options,
+                                    std::size_t jobs, std::FILE* log) {
+  ManifestResult result;
+
+  // Workers share one directory cache. Fsync is not batched here: a record
+  // written to the log must describe a file that is already in place.
+  DirectoryCache dirs;
+  CopyOptions file_options = options;
+  file_options.batch = nullptr;
+  if (!file_options.dirs) {
+    file_options.dirs = &dirs;
+  }
+
+  // Counters are only touched from the serialised completion callback
+  CopyPool pool(jobs, file_options,
+                [&](const CopyJob& job, const CopyResult& copy) {
+                  const char* status = "ok";
+                  if (!copy.success) {
+                    status = "failed";
+                    ++result.files_failed;
+                  } else if (copy.skipped) {
+                    status = "skipped";
+                    ++result.files_skipped;
+                  } else {
+                    ++result.files_copied;
+                    result.bytes_copied += copy.bytes_copied;
+                  }
+                  detail::write_log_record(log, job.id, status,
+                                           copy.bytes_copied, job.source,
+                                           job.dest, copy.error_message);
+                });
+
+  std::size_t line_number = 0;
+  bool opened = cli::StdinReader::for_each_line_from(
+      manifest, [&](const std::string& line) {
+        ++line_number;
+        if (line.empty() || line == "\r" || line[0] == '#') {
+          return true;
+        }
+        ++result.entries;
+        CopyJob job;
+        job.id = line_number;
+        if (!parse_manifest_line(line, job.source, job.dest)) {
+          // Reported as a failed copy, serialised with the workers' records
+          CopyResult copy;
+          copy.error_message = "Malformed manifest line";
+          pool.complete(CopyJob{job.id}, copy);
+          return true;
+        }
+        pool.submit(std::move(job));
+        return true;
+      });
+  pool.finish();
+
+  if (!opened) {
+    result.error_message = "Failed to open manifest: " + manifest;
+    return result;
+  }
+  result.success = result.files_failed == 0;
+  return result;
+}
+
+}  // namespace cp_file
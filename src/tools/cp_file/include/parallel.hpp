@@ -0,0 +1,120 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cp_file.hpp"
+
+namespace cp_file {
+
+/// One copy handed to a CopyPool
+struct CopyJob {
+  std::size_t id = 0;  // Caller-chosen key echoed back with the result
+  std::string source;
+  std::string dest;
+};
+
+/// Runs copy_file on a fixed set of worker threads. The queue is bounded,
+/// so a producer streaming millions of jobs blocks instead of buffering
+/// them all. Completion callbacks are serialised, so they can write to a
+/// shared log without their own locking.
+class CopyPool {
+ public:
+  using Callback = std::function<void(const CopyJob&, const CopyResult&)>;
+
+  /// @param workers Number of copy threads (at least one)
+  /// @param options Options for every copy; shared caches must be thread-safe
+  /// @param on_done Called once per job from a worker thread, or from the
+  ///        caller of complete()
+  CopyPool(std::size_t workers, const CopyOptions& options, Callback on_done)
+      : options_(options),
+        on_done_(std::move(on_done)),
+        queue_limit_(workers == 0 ? 4 : workers * 4) {
+    if (workers == 0) {
+      workers = 1;
+    }
+    for (std::size_t i = 0; i < workers; ++i) {
+      threads_.emplace_back([this] { loop(); });
+    }
+  }
+
+  ~CopyPool() { finish(); }
+
+  CopyPool(const CopyPool&) = delete;
+  CopyPool& operator=(const CopyPool&) = delete;
+
+  /// Queue a copy, waiting while the queue is full
+  void submit(CopyJob job) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      space_cv_.wait(lock, [this] { return queue_.size() < queue_limit_; });
+      queue_.push_back(std::move(job));
+    }
+    work_cv_.notify_one();
+  }
+
+  /// Report a job that the caller settled without copying (e.g. one it
+  /// rejected), through the same serialised callback as the workers
+  void complete(const CopyJob& job, const CopyResult& result) {
+    std::lock_guard<std::mutex> lock(done_mutex_);
+    on_done_(job, result);
+  }
+
+  /// Run every queued job to completion and stop the workers
+  void finish() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& thread : threads_) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+
+ private:
+  void loop() {
+    for (;;) {
+      CopyJob job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        job = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      space_cv_.notify_one();
+
+      CopyResult result = copy_file(job.source, job.dest, options_);
+
+      std::lock_guard<std::mutex> lock(done_mutex_);
+      on_done_(job, result);
+    }
+  }
+
+  CopyOptions options_;
+  Callback on_done_;
+  std::size_t queue_limit_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable space_cv_;
+  std::deque<CopyJob> queue_;
+  bool stopping_ = false;
+
+  std::mutex done_mutex_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace cp_file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+
+namespace cp_file {
+
+/// Buffer alignment that satisfies O_DIRECT on common block devices
+constexpr std::size_t kIoAlignment = 4096;
+
+namespace detail {
+
+/// Owning wrapper around a POSIX file descriptor
+class UniqueFd {
+ public:
+  UniqueFd() = default;
+  explicit UniqueFd(int fd) : fd_(fd) {}
+  ~UniqueFd() { reset(); }
+
+  UniqueFd(UniqueFd&& other) noexcept : fd_(other.release()) {}
+  UniqueFd& operator=(UniqueFd&& other) noexcept {
+    if (this != &other) {
+      reset(other.release());
+    }
+    return *this;
+  }
+  UniqueFd(const UniqueFd&) = delete;
+  UniqueFd& operator=(const UniqueFd&) = delete;
+
+  int get() const { return fd_; }
+  bool valid() const { return fd_ >= 0; }
+
+  int release() {
+    int fd = fd_;
+    fd_ = -1;
+    return fd;
+  }
+
+  void reset(int fd = -1) {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    fd_ = fd;
+  }
+
+ private:
+  int fd_ = -1;
+};
+
+/// Heap buffer aligned to kIoAlignment, released with free()
+struct FreeDeleter {
+  void operator()(char* p) const { std::free(p); }
+};
+using AlignedBuffer = std::unique_ptr<char[], FreeDeleter>;
+
+/// Files smaller than this are not preallocated: one write allocates them
+/// just as well, and the extra syscall would dominate
+constexpr std::uint64_t kPreallocateMin = 1 << 20;
+
+/// Reserve disk blocks for [offset, offset + len) without changing the file
+/// size (FALLOC_FL_KEEP_SIZE), so a large file is laid out in few extents
+/// and a full disk is reported before the copy starts. A partial copy
+/// still has its true length, which resume and update rely on.
+/// @return false with errno set only when space or quota ran out; a
+///         filesystem without fallocate is not an error
+inline bool preallocate(int fd, std::uint64_t offset, std::uint64_t len) {
+  if (len < kPreallocateMin) {
+    return true;
+  }
+  int rc;
+  do {
+    rc = ::fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset),
+                     static_cast<off_t>(len));
+  } while (rc != 0 && errno == EINTR);
+  return rc == 0 || (errno != ENOSPC && errno != EDQUOT);
+}
+
+/// Allocate an aligned I/O buffer (throws std::bad_alloc on failure)
+inline AlignedBuffer make_aligned_buffer(std::size_t size) {
+  void* p = nullptr;
+  if (::posix_memalign(&p, kIoAlignment, size) != 0) {
+    throw std::bad_alloc();
+  }
+  return AlignedBuffer(static_cast<char*>(p));
+}
+
+/// Build an error message of the form "<what>: <path>: <strerror(errno)>"
+inline std::string errno_message(const std::string& what,
+                                 const std::string& path, int err) {
+  return what + ": " + path + ": " + std::strerror(err);
+}
+
+/// Write the whole buffer, retrying on short writes and EINTR
+/// @return true on success, false with errno set on failure
+inline bool write_all(int fd, const char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+/// Write the whole buffer at offset, retrying on short writes and EINTR
+/// @return true on success, false with errno set on failure
+inline bool pwrite_all(int fd, const char* data, std::size_t size,
+                       off_t offset) {
+  while (size > 0) {
+    ssize_t n = ::pwrite(fd, data, size, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= static_cast<std::size_t>(n);
+    offset += n;
+  }
+  return true;
+}
+
+/// Read exactly size bytes at offset, retrying on short reads and EINTR
+/// @return true on success, false on error (errno set) or premature EOF
+inline bool pread_all(int fd, char* data, std::size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = ::pread(fd, data, size, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0) {
+      errno = 0;
+      return false;
+    }
+    data += n;
+    size -= static_cast<std::size_t>(n);
+    offset += n;
+  }
+  return true;
+}
+
+}  // namespace detail
+}  // namespace cp_file
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace cp_file {
+
+/// Point-in-time copy of the progress counters
+struct ProgressSnapshot {
+  std::uint64_t bytes_done = 0;
+  std::uint64_t bytes_total = 0;
+  std::uint64_t file_bytes_done = 0;
+  std::uint64_t file_bytes_total = 0;
+  bool has_current_file = true;  // False once copies have overlapped
+  std::uint64_t files_done = 0;
+  std::uint64_t files_total = 0;
+  std::uint64_t files_failed = 0;
+};
+
+/// Progress counters shared between copy loops and a reporter thread.
+/// All updates are relaxed atomic operations: the copy loop never takes a
+/// lock, and readers only need an approximately consistent view. The
+/// per-file counters describe "the current file" only while copies run
+/// one at a time; once two overlap (parallel workers) they are dropped.
+class Progress {
+ public:
+  /// Declare the totals up front (e.g. after scanning a tree).
+  /// If never called, totals grow as files are started.
+  void set_totals(std::uint64_t files, std::uint64_t bytes) {
+    files_total_.store(files, std::memory_order_relaxed);
+    bytes_total_.store(bytes, std::memory_order_relaxed);
+    totals_fixed_.store(true, std::memory_order_relaxed);
+  }
+
+  /// Called when a file copy starts
+  void begin_file(std::uint64_t file_size) {
+    if (in_flight_.fetch_add(1, std::memory_order_relaxed) > 0) {
+      overlapped_.store(true, std::memory_order_relaxed);
+    }
+    file_bytes_done_.store(0, std::memory_order_relaxed);
+    file_bytes_total_.store(file_size, std::memory_order_relaxed);
+    if (!totals_fixed_.load(std::memory_order_relaxed)) {
+      files_total_.fetch_add(1, std::memory_order_relaxed);
+      bytes_total_.fetch_add(file_size, std::memory_order_relaxed);
+    }
+  }
+
+  /// Called from the copy loop after each chunk is written
+  void add_bytes(std::uint64_t count) {
+    bytes_done_.fetch_add(count, std::memory_order_relaxed);
+    file_bytes_done_.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  /// Called when a file copy finishes (successfully or not), once for
+  /// every begin_file
+  void end_file(bool success) {
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    files_done_.fetch_add(1, std::memory_order_relaxed);
+    if (!success) {
+      files_failed_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  ProgressSnapshot snapshot() const {
+    ProgressSnapshot snap;
+    snap.bytes_done = bytes_done_.load(std::memory_order_relaxed);
+    snap.bytes_total = bytes_total_.load(std::memory_order_relaxed);
+    snap.file_bytes_done = file_bytes_done_.load(std::memory_order_relaxed);
+    snap.file_bytes_total = file_bytes_total_.load(std::memory_order_relaxed);
+    snap.has_current_file = !overlapped_.load(std::memory_order_relaxed);
+    snap.files_done = files_done_.load(std::memory_order_relaxed);
+    snap.files_total = files_total_.load(std::memory_order_relaxed);
+    snap.files_failed = files_failed_.load(std::memory_order_relaxed);
+    return snap;
+  }
+
+ private:
+  std::atomic<std::uint64_t> bytes_done_{0};
+  std::atomic<std::uint64_t> bytes_total_{0};
+  std::atomic<std::uint64_t> file_bytes_done_{0};
+  std::atomic<std::uint64_t> file_bytes_total_{0};
+  std::atomic<std::uint64_t> files_done_{0};
+  std::atomic<std::uint64_t> files_total_{0};
+  std::atomic<std::uint64_t> files_failed_{0};
+  std::atomic<bool> totals_fixed_{false};
+  std::atomic<std::uint64_t> in_flight_{0};
+  std::atomic<bool> overlapped_{false};
+};
+
+/// Format a byte count with a binary unit suffix (e.g. "1.5 GiB")
+inline std::string format_bytes(std::uint64_t bytes) {
+  static const char* const units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+  double value = static_cast<double>(bytes);
+  std::size_t unit = 0;
+  while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+    value /= 1024.0;
+    ++unit;
+  }
+  char buf[32];
+  if (unit == 0) {
+    std::snprintf(buf, sizeof(buf), "%llu B",
+                  static_cast<unsigned long long>(bytes));
+  } else {
+    std::snprintf(buf, sizeof(buf), "%.1f %s", value, units[unit]);
+  }
+  return buf;
+}
+
+/// Format a duration in seconds as H:MM:SS, or "--:--" if unknown
+inline std::string format_eta(double seconds) {
+  if (!(seconds >= 0.0) || seconds > 360000.0) {
+    return "--:--";
+  }
+  auto total = static_cast<unsigned long>(seconds + 0.5);
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%lu:%02lu:%02lu", total / 3600,
+                (total / 60) % 60, total % 60);
+  return buf;
+}
+
+/// Build one status line from a snapshot and measured rates (bytes/second)
+inline std::string format_progress_line(const ProgressSnapshot& snap,
+                                        double instant_rate,
+                                        double average_rate) {
+  constexpr double mb = 1000.0 * 1000.0;
+  double eta = -1.0;
+  if (average_rate > 0.0 && snap.bytes_total >= snap.bytes_done) {
+    eta = static_cast<double>(snap.bytes_total - snap.bytes_done) /
+          average_rate;
+  }
+
+  char buf[256];
+  std::snprintf(buf, sizeof(buf),
+                "%s / %s  %.1f MB/s (avg %.1f MB/s)  ETA %s",
+                format_bytes(snap.bytes_done).c_str(),
+                format_bytes(snap.bytes_total).c_str(), instant_rate / mb,
+                average_rate / mb, format_eta(eta).c_str());
+  std::string line = buf;
+
+  if (snap.files_total > 1) {
+    std::snprintf(buf, sizeof(buf), "  [files %llu/%llu",
+                  static_cast<unsigned long long>(snap.files_done),
+                  static_cast<unsigned long long>(snap.files_total));
+    line += buf;
+    if (snap.files_failed > 0) {
+      std::snprintf(buf, sizeof(buf), ", %llu failed",
+                    static_cast<unsigned long long>(snap.files_failed));
+      line += buf;
+    }
+    if (snap.has_current_file) {
+      std::snprintf(buf, sizeof(buf), ", current %s/%s",
+                    format_bytes(snap.file_bytes_done).c_str(),
+                    format_bytes(snap.file_bytes_total).c_str());
+      line += buf;
+    }
+    line += "]";
+  }
+  return line;
+}
+
+/// Background thread that samples a Progress and redraws a status line on a
+/// stream at a capped rate. The final line is printed when stopped.
+class ProgressReporter {
+ public:
+  explicit ProgressReporter(
+      const Progress& progress, std::FILE* out = stderr,
+      std::chrono::milliseconds interval = std::chrono::milliseconds(100))
+      : progress_(progress),
+        out_(out),
+        interval_(interval),
+        start_(std::chrono::steady_clock::now()),
+        last_time_(start_) {
+    thread_ = std::thread([this] { loop(); });
+  }
+
+  ~ProgressReporter() { stop(); }
+
+  ProgressReporter(const ProgressReporter&) = delete;
+  ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+  /// Stop the reporter thread and print the final status line
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopped_) {
+        return;
+      }
+      stopped_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    draw();
+    std::fputc('\n', out_);
+    std::fflush(out_);
+  }
+
+ private:
+  void loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, interval_, [this] { return stopped_; })) {
+      draw();
+    }
+  }
+
+  void draw() {
+    auto now = std::chrono::steady_clock::now();
+    auto snap = progress_.snapshot();
+
+    double elapsed = std::chrono::duration<double>(now - start_).count();
+    double delta_t = std::chrono::duration<double>(now - last_time_).count();
+    double average = elapsed > 0.0 ? snap.bytes_done / elapsed : 0.0;
+    double instant =
+        delta_t > 0.0 ? (snap.bytes_done - last_bytes_) / delta_t : 0.0;
+    last_time_ = now;
+    last_bytes_ = snap.bytes_done;
+
+    std::fprintf(out_, "\r\033[K%s",
+                 format_progress_line(snap, instant, average).c_str());
+    std::fflush(out_);
+  }
+
+  const Progress& progress_;
+  std::FILE* out_;
+  std::chrono::milliseconds interval_;
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point last_time_;
+  std::uint64_t last_bytes_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+}  // namespace cp_file
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "checksum.hpp"
+#include "posix_io.hpp"
+
+namespace cp_file {
+
+/// Bytes copied between journal commits (each commit costs one fdatasync)
+constexpr std::uint64_t kJournalCommitInterval = 64ull << 20;
+
+/// Resume offsets without a journal are rounded down to this boundary
+constexpr std::uint64_t kResumeAlignment = 1ull << 20;
+
+/// Size and number of blocks compared when verifying a partial destination
+constexpr std::size_t kVerifyBlockSize = 64 << 10;
+constexpr std::size_t kVerifySampleCount = 16;
+
+/// Identity of the source a journal was written for; a journal is only
+/// trusted if the source still has the same size and modification time
+struct SourceIdentity {
+  std::uint64_t size = 0;
+  std::int64_t mtime_sec = 0;
+  std::int64_t mtime_nsec = 0;
+
+  static SourceIdentity from_stat(const struct stat& st) {
+    SourceIdentity id;
+    id.size = static_cast<std::uint64_t>(st.st_size);
+    id.mtime_sec = static_cast<std::int64_t>(st.st_mtim.tv_sec);
+    id.mtime_nsec = static_cast<std::int64_t>(st.st_mtim.tv_nsec);
+    return id;
+  }
+
+  bool operator==(const SourceIdentity& other) const {
+    return size == other.size && mtime_sec == other.mtime_sec &&
+           mtime_nsec == other.mtime_nsec;
+  }
+};
+
+/// State of a journal found next to a destination
+enum class JournalStatus {
+  Missing,  // No journal file
+  Stale,    // Journal exists but was written for a different source
+  Valid     // Journal matches the source; committed offset is usable
+};
+
+/// Sidecar journal recording committed chunk boundaries of a copy.
+/// Format: a header line followed by one committed offset per line. An
+/// offset is only appended after the destination has been fdatasync'ed up
+/// to it, so the last complete line is always safe to resume from.
+class ResumeJournal {
+ public:
+  /// Journal path for a destination file
+  static std::string path_for(const std::string& dest) {
+    return dest + ".cpjournal";
+  }
+
+  /// Read the last committed offset from an existing journal
+  static JournalStatus load(const std::string& path, const SourceIdentity& id,
+                            std::uint64_t& committed) {
+    std::ifstream file(path);
+    if (!file) {
+      return JournalStatus::Missing;
+    }
+
+    std::string magic;
+    int version = 0;
+    SourceIdentity stored;
+    file >> magic >> version >> stored.size >> stored.mtime_sec >>
+        stored.mtime_nsec;
+    if (!file || magic != "cp_file-journal" || version != 1 || !(stored == id)) {
+      return JournalStatus::Stale;
+    }
+
+    committed = 0;
+    std::uint64_t offset = 0;
+    while (file >> offset) {
+      committed = offset;
+    }
+    return JournalStatus::Valid;
+  }
+
+  ResumeJournal() = default;
+  ~ResumeJournal() { close(); }
+
+  ResumeJournal(const ResumeJournal&) = delete;
+  ResumeJournal& operator=(const ResumeJournal&) = delete;
+
+  /// Create (or replace) the journal and record the starting offset
+  bool open(const std::string& path, const SourceIdentity& id,
+            std::uint64_t start_offset) {
+    close();
+    path_ = path;
+    file_ = std::fopen(path.c_str(), "w");
+    if (!file_) {
+      return false;
+    }
+    std::fprintf(file_, "cp_file-journal 1 %" PRIu64 " %" PRId64 " %" PRId64
+                        "\n",
+                 id.size, id.mtime_sec, id.mtime_nsec);
+    return commit(start_offset);
+  }
+
+  /// Record that every byte before offset is durable in the destination
+  bool commit(std::uint64_t offset) {
+    if (!file_) {
+      return false;
+    }
+    std::fprintf(file_, "%" PRIu64 "\n", offset);
+    return std::fflush(file_) == 0;
+  }
+
+  /// Close and delete the journal (called once the copy is complete)
+  void remove() {
+    close();
+    if (!path_.empty()) {
+      std::remove(path_.c_str());
+    }
+  }
+
+  bool is_open() const { return file_ != nullptr; }
+
+ private:
+  void close() {
+    if (file_) {
+      std::fclose(file_);
+      file_ = nullptr;
+    }
+  }
+
+  std::string path_;
+  std::FILE* file_ = nullptr;
+};
+
+/// Verify a copied prefix by comparing checksums of sampled blocks
+/// @param src_fd Source file descriptor
+/// @param dst_fd Partial destination file descriptor
+/// @param offset Length of the prefix believed to be copied
+/// @return Largest offset <= offset that is safe to resume from; the prefix
+///         is cut back to the aligned start of the first mismatching block
+inline std::uint64_t verify_prefix(int src_fd, int dst_fd,
+                                   std::uint64_t offset) {
+  if (offset == 0) {
+    return 0;
+  }
+
+  std::unique_ptr<char[]> src_buf(new char[kVerifyBlockSize]);
+  std::unique_ptr<char[]> dst_buf(new char[kVerifyBlockSize]);
+
+  // Evenly spaced samples plus the block just before the resume point,
+  // which is the one most likely to be torn
+  std::uint64_t stride = std::max<std::uint64_t>(offset / kVerifySampleCount,
+                                                 kVerifyBlockSize);
+  for (std::uint64_t pos = 0; pos < offset; pos += stride) {
+    std::uint64_t start = pos;
+    if (pos + stride >= offset) {
+      start = offset > kVerifyBlockSize ? offset - kVerifyBlockSize : 0;
+    }
+    std::size_t len = static_cast<std::size_t>(
+        std::min<std::uint64_t>(kVerifyBlockSize, offset - start));
+
+    bool ok = detail::pread_all(src_fd, src_buf.get(), len,
+                                static_cast<off_t>(start)) &&
+              detail::pread_all(dst_fd, dst_buf.get(), len,
+                                static_cast<off_t>(start)) &&
+              crc32c(src_buf.get(), len) == crc32c(dst_buf.get(), len);
+    if (!ok) {
+      return start - start % kResumeAlignment;
+    }
+    if (start != pos) {
+      break;
+    }
+  }
+  return offset;
+}
+
+}  // namespace cp_file
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+
+#include "cp_file.hpp"
+#include "dir_cache.hpp"
+#include "durability.hpp"
+
+namespace cp_file {
+
+/// Path that stands for stdin (as source) or stdout (as destination)
+inline bool is_stdio_path(const std::string& path) { return path == "-"; }
+
+namespace detail {
+
+/// Move data between descriptors with splice(), which needs a pipe on at
+/// least one side and never copies the bytes through user space
+/// @param unsupported Set if splice cannot be used for this pair at all
+/// @return true at EOF; false on error (error_message filled in unless
+///         unsupported is set)
+inline bool splice_contents(CopyLoop& loop, const std::string& source,
+                            const std::string& dest, CopyResult& result,
+                            bool& unsupported) {
+  unsupported = false;
+  for (;;) {
+    ssize_t n = ::splice(loop.in_fd, nullptr, loop.out_fd, nullptr,
+                         kCopyBufferSize, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // e.g. an O_APPEND destination; nothing has moved yet, so the
+      // buffered loop can take over cleanly
+      if (errno == EINVAL && loop.position == 0) {
+        unsupported = true;
+        return false;
+      }
+      result.error_message = errno_message(
+          "Failed to splice", source + " -> " + dest, errno);
+      return false;
+    }
+    if (n == 0) {
+      return true;
+    }
+    if (loop.throttle) {
+      loop.throttle->acquire(static_cast<std::uint64_t>(n), 1);
+    }
+    result.bytes_copied += static_cast<std::size_t>(n);
+    loop.position += static_cast<std::uint64_t>(n);
+    if (loop.progress) {
+      loop.progress->add_bytes(static_cast<std::uint64_t>(n));
+    }
+  }
+}
+
+inline bool is_pipe(int fd) {
+  struct stat st;
+  return ::fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+}  // namespace detail
+
+/// Copy between a file and stdin/stdout ("-" on either side), e.g. at the
+/// end of a pipeline: `producer | cp_file - out.bin`. When one side is a
+/// pipe the data moves with splice(); otherwise a large-buffer read/write
+/// loop is used. A size hint preallocates a file destination up front (the
+/// unused part of a too-large hint is trimmed at the end). Durability
+/// Atomic and Fsync apply to a file destination; verify, direct, resume,
+/// update and delta are not supported here.
+/// @param source Source path, or "-" for stdin
+/// @param dest Destination path, or "-" for stdout
+/// @param options Copy options (overwrite, progress, throttle, durability)
+/// @param size_hint Expected number of bytes (0 if unknown)
+/// @return CopyResult with status and bytes copied
+inline CopyResult copy_stream(const std::string& source,
+                              const std::string& dest,
+                              const CopyOptions& options,
+                              std::uint64_t size_hint = 0) {
+  CopyResult result;
+
+  // Every attempted copy reaches end_file, including one that fails before
+  // any data moves
+  bool progress_begun = false;
+  auto finish = [&]() -> CopyResult& {
+    if (options.progress) {
+      if (!progress_begun) {
+        options.progress->begin_file(0);
+      }
+      options.progress->end_file(result.success);
+    }
+    return result;
+  };
+
+  detail::UniqueFd own_in;
+  int in_fd = STDIN_FILENO;
+  if (!is_stdio_path(source)) {
+    own_in.reset(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!own_in.valid()) {
+      result.error_message =
+          errno == ENOENT
+              ? "Source file does not exist: " + source
+              : detail::errno_message("Failed to open source", source, errno);
+      return finish();
+    }
+    in_fd = own_in.get();
+    struct stat st;
+    if (::fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && size_hint == 0) {
+      size_hint = static_cast<std::uint64_t>(st.st_size);
+    }
+  }
+
+  // Under Atomic/Fsync a file destination is written under a temp name and
+  // renamed into place, as copy_file does
+  bool use_temp =
+      !is_stdio_path(dest) && options.durability != Durability::None;
+  std::string write_path = dest;
+  detail::UniqueFd own_out;
+  int out_fd = STDOUT_FILENO;
+  if (!is_stdio_path(dest)) {
+    // A replaced file keeps its permissions; a new one gets 0666 less the
+    // umask, as with a shell redirection
+    struct stat dest_st;
+    bool dest_exists = ::stat(dest.c_str(), &dest_st) == 0;
+    bool keep_mode = dest_exists && S_ISREG(dest_st.st_mode);
+    mode_t mode = keep_mode ? dest_st.st_mode & 07777 : 0666;
+    if (use_temp) {
+      if (dest_exists && !options.overwrite) {
+        result.error_message = "Destination already exists: " + dest;
+        return finish();
+      }
+      std::string dest_dir;
+      std::string dest_name;
+      split_path(dest, dest_dir, dest_name);
+      write_path = dest_dir + "/" + make_temp_name(dest_name);
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    flags |= (use_temp || !options.overwrite) ? O_EXCL : O_TRUNC;
+    own_out.reset(::open(write_path.c_str(), flags, mode));
+    if (!own_out.valid()) {
+      result.error_message =
+          errno == EEXIST && !use_temp
+              ? "Destination already exists: " + dest
+              : detail::errno_message("Failed to open destination", dest,
+                                      errno);
+      return finish();
+    }
+    out_fd = own_out.get();
+    if (use_temp && keep_mode) {
+      ::fchmod(out_fd, mode);  // Undo the umask on the temp file
+    }
+  }
+  TempFileGuard temp_guard(AT_FDCWD, use_temp ? write_path : std::string());
+
+  // Only a file opened here is preallocated and trimmed: a redirected
+  // stdout may be appending to data that must be left alone
+  struct stat out_st;
+  bool out_regular = ::fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode);
+  bool preallocate = own_out.valid() && out_regular && size_hint > 0;
+  if (preallocate && !detail::preallocate(out_fd, 0, size_hint)) {
+    result.error_message = detail::errno_message(
+        "Not enough space for destination", dest, errno);
+    return finish();
+  }
+
+  if (options.progress) {
+    options.progress->begin_file(size_hint);
+    progress_begun = true;
+  }
+
+  detail::CopyLoop loop;
+  loop.in_fd = in_fd;
+  loop.out_fd = out_fd;
+  loop.progress = options.progress;
+  loop.throttle = options.throttle;
+
+  bool unsupported = true;
+  if (detail::is_pipe(in_fd) || detail::is_pipe(out_fd)) {
+    result.success =
+        detail::splice_contents(loop, source, dest, result, unsupported);
+  }
+  if (!result.success && unsupported) {
+    result.success = detail::copy_fd_contents(loop, source, dest, result);
+  }
+
+  // Drop preallocated blocks past the data if the hint was too large
+  if (result.success && preallocate && size_hint > loop.position &&
+      ::ftruncate(out_fd, static_cast<off_t>(loop.position)) != 0) {
+    result.success = false;
+    result.error_message =
+        detail::errno_message("Failed to truncate", dest, errno);
+  }
+
+  if (result.success && out_regular &&
+      options.durability == Durability::Fsync && ::fdatasync(out_fd) != 0) {
+    result.success = false;
+    result.error_message =
+        detail::errno_message("Failed to sync destination", dest, errno);
+  }
+
+  if (result.success && own_out.valid() && ::close(own_out.release()) != 0) {
+    result.success = false;
+    result.error_message =
+        detail::errno_message("Failed to close destination", dest, errno);
+  }
+
+  if (result.success && use_temp) {
+    if (!rename_into_place(AT_FDCWD, write_path, AT_FDCWD, dest,
+                           options.overwrite)) {
+      result.success = false;
+      result.error_message =
+          errno == EEXIST
+              ? "Destination already exists: " + dest
+              : detail::errno_message("Failed to rename into place", dest,
+                                      errno);
+    } else {
+      temp_guard.dismiss();
+      std::string dest_dir;
+      std::string dest_name;
+      split_path(dest, dest_dir, dest_name);
+      if (options.durability == Durability::Fsync &&
+          !fsync_directory(dest_dir)) {
+        result.success = false;
+        result.error_message = detail::errno_message(
+            "Failed to sync directory", dest_dir, errno);
+      }
+    }
+  }
+
+  return finish();
+}
+
+}  // namespace cp_file
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "posix_io.hpp"
+#include "verify.hpp"
+
+namespace cp_file {
+
+/// Metadata used to decide whether a destination is up to date
+struct FileMeta {
+  bool exists = false;
+  bool is_regular = false;
+  std::uint64_t size = 0;
+  std::int64_t mtime_sec = 0;
+  std::uint32_t mtime_nsec = 0;
+
+  /// Metadata of an already open file
+  static FileMeta from_stat(const struct stat& st) {
+    FileMeta meta;
+    meta.exists = true;
+    meta.is_regular = S_ISREG(st.st_mode);
+    meta.size = static_cast<std::uint64_t>(st.st_size);
+    meta.mtime_sec = st.st_mtim.tv_sec;
+    meta.mtime_nsec = static_cast<std::uint32_t>(st.st_mtim.tv_nsec);
+    return meta;
+  }
+};
+
+/// Fetch size, type and mtime with a single statx call
+/// @return FileMeta with exists == false if the path cannot be stat'ed
+inline FileMeta stat_meta(const std::string& path) {
+  FileMeta meta;
+  struct statx stx;
+  if (::statx(AT_FDCWD, path.c_str(), AT_STATX_SYNC_AS_STAT,
+              STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx) != 0) {
+    return meta;
+  }
+  meta.exists = true;
+  meta.is_regular = S_ISREG(stx.stx_mode);
+  meta.size = stx.stx_size;
+  meta.mtime_sec = stx.stx_mtime.tv_sec;
+  meta.mtime_nsec = stx.stx_mtime.tv_nsec;
+  return meta;
+}
+
+/// Compute the CRC-32C of a whole file
+/// @return false if the file cannot be read
+inline bool file_checksum(const std::string& path, std::uint32_t& crc) {
+  detail::UniqueFd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  return fd.valid() && checksum_fd(fd.get(), 0, crc);
+}
+
+/// Compare two files of equal size byte for byte
+/// @return false if they differ or either cannot be read
+inline bool files_identical(const std::string& a, const std::string& b,
+                            std::uint64_t size) {
+  detail::UniqueFd fd_a(::open(a.c_str(), O_RDONLY | O_CLOEXEC));
+  detail::UniqueFd fd_b(::open(b.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!fd_a.valid() || !fd_b.valid()) {
+    return false;
+  }
+  constexpr std::size_t chunk = 1 << 20;
+  auto buf_a = detail::make_aligned_buffer(chunk);
+  auto buf_b = detail::make_aligned_buffer(chunk);
+  for (std::uint64_t offset = 0; offset < size; offset += chunk) {
+    auto len = static_cast<std::size_t>(
+        std::min<std::uint64_t>(chunk, size - offset));
+    if (!detail::pread_all(fd_a.get(), buf_a.get(), len,
+                           static_cast<off_t>(offset)) ||
+        !detail::pread_all(fd_b.get(), buf_b.get(), len,
+                           static_cast<off_t>(offset)) ||
+        std::memcmp(buf_a.get(), buf_b.get(), len) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Set a file's modification time, leaving the access time untouched
+inline bool set_mtime(int fd, std::int64_t sec, std::uint32_t nsec) {
+  struct timespec times[2];
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_OMIT;
+  times[1].tv_sec = static_cast<time_t>(sec);
+  times[1].tv_nsec = static_cast<long>(nsec);
+  return ::futimens(fd, times) == 0;
+}
+
+/// Decide whether dest already matches source.
+/// By default size and mtime must match. With compare_content, files of
+/// equal size are compared byte for byte instead, and a matching
+/// destination gets its mtime refreshed so the next run takes the metadata
+/// fast path.
+inline bool is_up_to_date(const std::string& source, const FileMeta& src_meta,
+                          const std::string& dest, bool compare_content) {
+  FileMeta dst_meta = stat_meta(dest);
+  if (!dst_meta.exists || !dst_meta.is_regular ||
+      dst_meta.size != src_meta.size) {
+    return false;
+  }
+
+  bool same_mtime = dst_meta.mtime_sec == src_meta.mtime_sec &&
+                    dst_meta.mtime_nsec == src_meta.mtime_nsec;
+  if (!compare_content) {
+    return same_mtime;
+  }
+
+  // Both files are read in full either way, so compare the bytes: a
+  // checksum collision would leave a changed destination stale
+  if (!files_identical(source, dest, src_meta.size)) {
+    return false;
+  }
+
+  if (!same_mtime) {
+    detail::UniqueFd fd(::open(dest.c_str(), O_WRONLY | O_CLOEXEC));
+    if (fd.valid()) {
+      set_mtime(fd.get(), src_meta.mtime_sec, src_meta.mtime_nsec);
+    }
+  }
+  return true;
+}
+
+}  // namespace cp_file
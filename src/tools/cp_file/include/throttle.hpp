@@ -0,0 +1,102 @@
+#pragma once
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace cp_file {
+
+/// Units a limiter lets through back to back before it starts pacing:
+/// one copy buffer of bytes, and one read plus one write of operations
+constexpr std::uint64_t kThrottleBurstBytes = 1 << 20;
+constexpr std::uint64_t kThrottleBurstOps = 2;
+
+/// Lock-free rate limiter using the generic cell rate algorithm (GCRA), the
+/// token bucket expressed as a single "theoretical arrival time". Each
+/// caller reserves its cost with one compare-and-swap and then sleeps until
+/// the reservation starts, so any number of workers share one limit without
+/// a mutex, and large requests are paced rather than split up.
+class RateLimiter {
+ public:
+  /// @param rate Units per second (0 means unlimited)
+  /// @param burst Units allowed back to back after an idle period
+  RateLimiter(double rate, std::uint64_t burst)
+      : ns_per_unit_(rate > 0.0 ? 1e9 / rate : 0.0),
+        tolerance_ns_(static_cast<std::int64_t>(ns_per_unit_ *
+                                                static_cast<double>(burst))) {}
+
+  bool enabled() const { return ns_per_unit_ > 0.0; }
+
+  /// Take count units, sleeping until the rate allows them
+  void acquire(std::uint64_t count) {
+    if (!enabled() || count == 0) {
+      return;
+    }
+    auto cost = static_cast<std::int64_t>(ns_per_unit_ *
+                                          static_cast<double>(count));
+    std::int64_t now = now_ns();
+    std::int64_t tat = tat_.load(std::memory_order_relaxed);
+    std::int64_t next;
+    do {
+      // An idle limiter does not bank credit beyond the burst tolerance
+      next = std::max(tat, now) + cost;
+    } while (!tat_.compare_exchange_weak(tat, next,
+                                         std::memory_order_relaxed));
+
+    std::int64_t wait = next - tolerance_ns_ - now;
+    if (wait > 0) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+    }
+  }
+
+ private:
+  static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  double ns_per_unit_;
+  std::int64_t tolerance_ns_;
+  std::atomic<std::int64_t> tat_{0};
+};
+
+/// Bandwidth and IOPS limits shared by every copy in a run
+class Throttle {
+ public:
+  /// @param bytes_per_sec Byte rate limit (0 means unlimited)
+  /// @param ops_per_sec I/O operation rate limit (0 means unlimited)
+  Throttle(double bytes_per_sec, double ops_per_sec)
+      : bytes_(bytes_per_sec, kThrottleBurstBytes),
+        ops_(ops_per_sec, kThrottleBurstOps) {}
+
+  bool enabled() const { return bytes_.enabled() || ops_.enabled(); }
+
+  /// Account for bytes transferred by ops system calls, waiting as needed
+  void acquire(std::uint64_t bytes, std::uint64_t ops) {
+    bytes_.acquire(bytes);
+    ops_.acquire(ops);
+  }
+
+ private:
+  RateLimiter bytes_;
+  RateLimiter ops_;
+};
+
+/// Put the calling thread in the idle I/O scheduling class, so it only gets
+/// disk time nobody else wants. Threads created afterwards inherit it.
+/// @return false with errno set if the kernel refuses
+inline bool set_idle_io_priority() {
+  constexpr int kIoprioWhoProcess = 1;
+  constexpr int kIoprioClassIdle = 3;
+  constexpr int kIoprioClassShift = 13;
+  return ::syscall(SYS_ioprio_set, kIoprioWhoProcess, 0,
+                   kIoprioClassIdle << kIoprioClassShift) == 0;
+}
+
+}  // namespace cp_file
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "cp_file.hpp"
+#include "dedup.hpp"
+
+namespace cp_file {
+
+/// Aggregate result of copying a directory tree
+struct TreeResult {
+  bool success = false;  // True if every file was copied or skipped
+  std::size_t files_copied = 0;
+  std::size_t files_skipped = 0;
+  std::size_t files_failed = 0;
+  std::size_t bytes_copied = 0;
+  std::size_t files_deduped = 0;    // Written as links to an identical copy
+  std::size_t bytes_saved = 0;      // Bytes those links did not rewrite
+  std::vector<std::string> errors;  // One message per failed entry
+};
+
+namespace detail {
+
+/// Add one file's outcome to the tree counters
+/// @return Whether the destination is in place (copied or up to date)
+inline bool record_copy(const CopyResult& file_result, TreeResult& result) {
+  if (!file_result.success) {
+    result.errors.push_back(file_result.error_message);
+    ++result.files_failed;
+  } else if (file_result.skipped) {
+    ++result.files_skipped;
+  } else {
+    ++result.files_copied;
+    result.bytes_copied += file_result.bytes_copied;
+  }
+  return file_result.success;
+}
+
+/// Write the duplicates found by find_duplicates() as links to the copy of
+/// their canonical file. A duplicate whose canonical copy failed, or that
+/// cannot be reflinked here, is copied normally.
+inline void write_duplicates(const std::vector<std::string>& sources,
+                             const std::vector<std::string>& targets,
+                             const std::vector<std::uint64_t>& sizes,
+                             const std::vector<std::size_t>& canonical,
+                             const std::vector<bool>& in_place,
+                             const CopyOptions& options, TreeResult& result) {
+  bool replace = options.overwrite || options.update;
+  for (std::size_t i = 0; i < sources.size(); ++i) {
+    std::size_t original = canonical[i];
+    if (original == i) {
+      continue;
+    }
+
+    struct stat st;
+    if (in_place[original] && ::stat(sources[i].c_str(), &st) == 0) {
+      if (options.update &&
+          is_up_to_date(sources[i], FileMeta::from_stat(st), targets[i],
+                        false)) {
+        ++result.files_skipped;
+        continue;
+      }
+      auto status = link_duplicate(
+          targets[original], targets[i], options.dedup, replace,
+          options.update, options.durability == Durability::Fsync, st,
+          *options.dirs);
+      if (status == LinkStatus::Linked) {
+        ++result.files_copied;
+        ++result.files_deduped;
+        result.bytes_saved += sizes[i];
+        continue;
+      }
+      if (status == LinkStatus::Failed) {
+        result.errors.push_back(
+            errno == EEXIST
+                ? "Destination already exists: " + targets[i]
+                : errno_message("Failed to link duplicate", targets[i], errno));
+        ++result.files_failed;
+        continue;
+      }
+    }
+
+    record_copy(copy_file(sources[i], targets[i], options), result);
+  }
+}
+
+}  // namespace detail
+
+/// Recursively copy the regular files under source into dest
+/// @param source Source directory
+/// @param dest Destination directory (created if missing)
+/// @param options Options applied to every file copy
+/// @return TreeResult with per-category counters and error messages
+inline TreeResult copy_tree(const std::string& source, const std::string& dest,
+                            const CopyOptions& options) {
+  TreeResult result;
+
+  namespace fs = std::filesystem;
+
+  std::error_code ec;
+  if (!fs::is_directory(source, ec)) {
+    result.errors.push_back("Source is not a directory: " + source);
+    result.files_failed = 1;
+    return result;
+  }
+
+  // Fsync durability is batched: one syncfs and one fsync per directory at
+  // the end instead of an fdatasync and directory fsync per file. Dedup
+  // links duplicates to copies made earlier in the same run, so those
+  // copies must already be in place and are synced individually.
+  DurabilityBatch batch;
+  CopyOptions file_options = options;
+  if (options.durability == Durability::Fsync && !options.batch &&
+      options.dedup == DedupMode::None) {
+    file_options.batch = &batch;
+  }
+
+  // Each destination directory is created once and then kept open, so
+  // files are created with openat() relative to it
+  DirectoryCache dirs;
+  if (!file_options.dirs) {
+    file_options.dirs = &dirs;
+  }
+
+  // With dedup every file is listed first so duplicates can be found
+  bool dedup = options.dedup != DedupMode::None;
+  std::vector<std::string> sources;
+  std::vector<std::string> targets;
+  std::vector<std::uint64_t> sizes;
+
+  fs::path src_root(source);
+  fs::path dst_root(dest);
+  fs::recursive_directory_iterator it(src_root, ec);
+  fs::recursive_directory_iterator end;
+  if (ec) {
+    result.errors.push_back("Failed to read directory: " + source + ": " +
+                            ec.message());
+    result.files_failed = 1;
+    return result;
+  }
+
+  for (; it != end; it.increment(ec)) {
+    if (ec) {
+      result.errors.push_back("Failed to read directory: " + ec.message());
+      ++result.files_failed;
+      break;
+    }
+
+    const auto& entry = *it;
+    fs::path target = dst_root / entry.path().lexically_relative(src_root);
+
+    if (entry.is_directory(ec)) {
+      if (!file_options.dirs->open(target.string())) {
+        result.errors.push_back(detail::errno_message(
+            "Failed to create directory", target.string(), errno));
+        ++result.files_failed;
+      }
+      continue;
+    }
+
+    if (!entry.is_regular_file(ec)) {
+      result.errors.push_back("Source is not a regular file: " +
+                              entry.path().string());
+      ++result.files_failed;
+      continue;
+    }
+
+    if (dedup) {
+      sources.push_back(entry.path().string());
+      targets.push_back(target.string());
+      sizes.push_back(entry.file_size(ec));
+      continue;
+    }
+
+    detail::record_copy(copy_file(entry.path().string(), target.string(),
+                                  file_options),
+                        result);
+  }
+
+  if (dedup) {
+    auto canonical = find_duplicates(sources, sizes);
+
+    // Canonical files are copied first; the rest become links to them
+    std::vector<bool> in_place(sources.size(), false);
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+      if (canonical[i] != i) {
+        continue;
+      }
+      in_place[i] = detail::record_copy(
+          copy_file(sources[i], targets[i], file_options), result);
+    }
+    detail::write_duplicates(sources, targets, sizes, canonical, in_place,
+                             file_options, result);
+  }
+
+  // Files that never made it into place count as failed, not copied
+  std::size_t uncommitted = batch.commit(result.errors);
+  result.files_failed += uncommitted;
+  result.files_copied -= std::min(result.files_copied, uncommitted);
+
+  result.success = result.errors.empty();
+  return result;
+}
+
+}  // namespace cp_file
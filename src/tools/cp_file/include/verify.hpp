@@ -0,0 +1,158 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "checksum.hpp"
+#include "posix_io.hpp"
+
+namespace cp_file {
+
+/// Checksums copy buffers on a separate thread so hashing overlaps with I/O.
+/// The copy loop takes a free buffer, fills and writes it, then submits it;
+/// the hasher thread folds buffers into a running CRC-32C in submission
+/// order and returns them to the free list. With a few buffers in flight
+/// the copy loop only waits when hashing falls behind the disk.
+class ChecksumPipeline {
+ public:
+  explicit ChecksumPipeline(std::size_t buffer_size, std::size_t depth = 4)
+      : buffer_size_(buffer_size) {
+    for (std::size_t i = 0; i < depth; ++i) {
+      storage_.push_back(detail::make_aligned_buffer(buffer_size));
+      free_.push_back(storage_.back().get());
+    }
+    thread_ = std::thread([this] { loop(); });
+  }
+
+  ~ChecksumPipeline() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  ChecksumPipeline(const ChecksumPipeline&) = delete;
+  ChecksumPipeline& operator=(const ChecksumPipeline&) = delete;
+
+  std::size_t buffer_size() const { return buffer_size_; }
+
+  /// Wait for a buffer that is no longer being hashed
+  char* acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !free_.empty(); });
+    char* buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+  }
+
+  /// Queue the first size bytes of an acquired buffer for hashing
+  void submit(char* buffer, std::size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.emplace_back(buffer, size);
+    }
+    cv_.notify_all();
+  }
+
+  /// Return an acquired buffer without hashing it
+  void release(char* buffer) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(buffer);
+    }
+    cv_.notify_all();
+  }
+
+  /// Wait until every submitted buffer is hashed and return the checksum
+  std::uint32_t finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return pending_.empty() && !busy_; });
+    return crc_;
+  }
+
+ private:
+  void loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+      if (pending_.empty()) {
+        return;
+      }
+      auto [buffer, size] = pending_.front();
+      pending_.pop_front();
+      busy_ = true;
+
+      lock.unlock();
+      std::uint32_t crc = crc32c(buffer, size, crc_);
+      lock.lock();
+
+      crc_ = crc;
+      busy_ = false;
+      free_.push_back(buffer);
+      cv_.notify_all();
+    }
+  }
+
+  std::size_t buffer_size_;
+  std::vector<detail::AlignedBuffer> storage_;
+  std::vector<char*> free_;
+  std::deque<std::pair<char*, std::size_t>> pending_;
+  std::uint32_t crc_ = 0;
+  bool busy_ = false;
+  bool stopping_ = false;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+
+/// Checksum a file from offset to EOF with pread (the file position is
+/// left untouched)
+/// @return false with errno set if the file cannot be read
+inline bool checksum_fd(int fd, std::uint64_t offset, std::uint32_t& crc) {
+  constexpr std::size_t buffer_size = 1 << 20;
+  auto buffer = detail::make_aligned_buffer(buffer_size);
+  crc = 0;
+  for (;;) {
+    ssize_t n = ::pread(fd, buffer.get(), buffer_size,
+                        static_cast<off_t>(offset));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0) {
+      return true;
+    }
+    crc = crc32c(buffer.get(), static_cast<std::size_t>(n), crc);
+    offset += static_cast<std::uint64_t>(n);
+  }
+}
+
+/// Re-read a written file from offset to EOF and checksum it, bypassing the
+/// page cache: the data is flushed with fdatasync and the now-clean pages
+/// dropped with POSIX_FADV_DONTNEED, so the bytes come back from the device
+/// rather than from the buffers that were just written.
+/// @return false with errno set if the file cannot be synced or read
+inline bool checksum_from_disk(int fd, std::uint64_t offset,
+                               std::uint32_t& crc) {
+  if (::fdatasync(fd) != 0) {
+    return false;
+  }
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::posix_fadvise(fd, static_cast<off_t>(offset), 0, POSIX_FADV_SEQUENTIAL);
+  return checksum_fd(fd, offset, crc);
+}
+
+}  // namespace cp_file
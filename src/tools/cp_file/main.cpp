@@ -1,9 +1,16 @@
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
+#include <optional>
 
 #include "cli.hpp"
 #include "cp_file.hpp"
+#include "manifest.hpp"
+#include "multicall.hpp"
+#include "stream.hpp"
+#include "tree.hpp"
 
-int main(int argc, char* argv[]) {
+static int cp_file_main(int argc, char* argv[]) {
   cli::CliExecutor executor("cp_file", "Copy files from source to destination");
   executor.set_usage("<source> <dest> [options]");
 
@@ -11,32 +18,244 @@ int main(int argc, char* argv[]) {
                     "Overwrite existing files");
   executor.add_flag("-v,--verbose", cli::FlagType::Boolean,
                     "Enable verbose output");
+  executor.add_flag("-p,--progress", cli::FlagType::Boolean,
+                    "Show live progress, throughput and ETA on stderr");
+  executor.add_flag("--resume", cli::FlagType::Boolean,
+                    "Continue an interrupted copy from its last checkpoint");
+  executor.add_flag("--verify-prefix", cli::FlagType::Boolean,
+                    "With --resume, check sampled blocks of the partial copy");
+  executor.add_flag("-r,--recursive", cli::FlagType::Boolean,
+                    "Copy a directory tree");
+  executor.add_flag("-u,--update", cli::FlagType::Boolean,
+                    "Skip files whose size and mtime match the destination");
+  executor.add_flag("--checksum", cli::FlagType::Boolean,
+                    "With --update, compare file contents instead of mtime");
+  executor.add_flag("--delta", cli::FlagType::Boolean,
+                    "Rewrite only the blocks of the destination that differ");
+  executor.add_flag("--verify", cli::FlagType::Boolean,
+                    "Checksum data in flight and compare with a re-read");
+  executor.add_flag("--direct", cli::FlagType::Boolean,
+                    "Bypass the page cache (O_DIRECT or fadvise fallback)");
+  executor.add_flag("--durability", cli::FlagType::Enum,
+                    "Crash safety: none, atomic (temp + rename) or fsync",
+                    false, {"none", "atomic", "fsync"});
+  executor.add_flag("--dedup", cli::FlagType::Boolean,
+                    "With -r, link identical files instead of copying them");
+  executor.add_flag("--dedup-mode", cli::FlagType::Enum,
+                    "How --dedup links files: reflink (default) or hardlink "
+                    "(implies --dedup)",
+                    false, {"reflink", "hardlink"});
+  executor.add_flag("--bwlimit", cli::FlagType::Double,
+                    "Limit total throughput to MB/s (shared by all workers)");
+  executor.add_flag("--iops-limit", cli::FlagType::Double,
+                    "Limit total read/write system calls per second");
+  executor.add_flag("--idle", cli::FlagType::Boolean,
+                    "Use the idle I/O scheduling class (ioprio_set)");
+  executor.add_flag("--size-hint", cli::FlagType::Size,
+                    "Expected size when copying from - (preallocates)");
+  executor.add_flag("--manifest", cli::FlagType::MultiArg,
+                    "Copy tab-separated source/dest pairs from a file or -");
+  executor.add_flag("-j,--jobs", cli::FlagType::UInt64,
+                    "Number of parallel copies in manifest mode (default 4)");
+  executor.add_flag("--log", cli::FlagType::MultiArg,
+                    "Write the manifest result log to a file (default stdout)");
 
   executor.set_handler([](const cli::ParseResult& result) {
-    if (result.positional_args.size() < 2) {
+    bool manifest_mode = result.has_flag("--manifest");
+    if (!manifest_mode && result.positional_args.size() < 2) {
       std::fprintf(stderr, "Error: Expected <source> <dest>\n");
       std::fprintf(stderr, "Use --help for usage information.\n");
       return 1;
     }
 
-    const std::string& source = result.positional_args[0];
-    const std::string& dest = result.positional_args[1];
     bool force = result.get_bool("--force");
     bool verbose = result.get_bool("--verbose");
+    bool show_progress = result.get_bool("--progress");
+
+    cp_file::Progress progress;
+    cp_file::CopyOptions options;
+    options.overwrite = force;
+    options.resume = result.get_bool("--resume");
+    options.verify_prefix = result.get_bool("--verify-prefix");
+    options.update = result.get_bool("--update");
+    options.compare_content = result.get_bool("--checksum");
+    options.delta = result.get_bool("--delta");
+    options.verify = result.get_bool("--verify");
+    options.direct = result.get_bool("--direct");
+    // Choices are declared in Durability order
+    if (auto durability = result.get<cli::Choice>("--durability")) {
+      options.durability = static_cast<cp_file::Durability>(durability->index);
+    }
+    // Choices are declared in DedupMode order, after None
+    if (auto mode = result.get<cli::Choice>("--dedup-mode")) {
+      options.dedup = static_cast<cp_file::DedupMode>(mode->index + 1);
+    } else if (result.get_bool("--dedup")) {
+      options.dedup = cp_file::DedupMode::Reflink;
+    }
+    if (show_progress) {
+      options.progress = &progress;
+    }
+
+    double limits[2] = {0.0, 0.0};
+    const char* limit_flags[2] = {"--bwlimit", "--iops-limit"};
+    for (int i = 0; i < 2; ++i) {
+      if (!result.has_flag(limit_flags[i])) {
+        continue;
+      }
+      limits[i] = *result.get<double>(limit_flags[i]);
+      if (!(limits[i] > 0.0)) {
+        std::fprintf(stderr, "Error: %s expects a positive number\n",
+                     limit_flags[i]);
+        return 1;
+      }
+    }
+    cp_file::Throttle throttle(limits[0] * 1000.0 * 1000.0, limits[1]);
+    if (throttle.enabled()) {
+      options.throttle = &throttle;
+    }
+
+    // Set before any worker thread starts so that they all inherit it
+    if (result.get_bool("--idle") && !cp_file::set_idle_io_priority()) {
+      std::fprintf(stderr, "Warning: Failed to set idle I/O priority: %s\n",
+                   std::strerror(errno));
+    }
+
+    std::optional<cp_file::ProgressReporter> reporter;
+    if (show_progress) {
+      reporter.emplace(progress);
+    }
+
+    if (manifest_mode) {
+      auto manifest_args = result.get_args("--manifest");
+      std::string manifest = manifest_args.empty() ? "-" : manifest_args[0];
+
+      std::size_t jobs = result.get<std::uint64_t>("--jobs").value_or(4);
+      if (jobs == 0) {
+        reporter.reset();
+        std::fprintf(stderr, "Error: --jobs expects a positive number\n");
+        return 1;
+      }
+
+      std::FILE* log = stdout;
+      auto log_args = result.get_args("--log");
+      if (!log_args.empty() && log_args[0] != "-") {
+        log = std::fopen(log_args[0].c_str(), "w");
+        if (!log) {
+          reporter.reset();
+          std::fprintf(stderr, "Error: Cannot open log file: %s\n",
+                       log_args[0].c_str());
+          return 1;
+        }
+      }
+
+      auto manifest_result =
+          cp_file::copy_manifest(manifest, options, jobs, log);
+      reporter.reset();
+      if (log != stdout) {
+        std::fclose(log);
+      }
+
+      if (!manifest_result.error_message.empty()) {
+        std::fprintf(stderr, "Error: %s\n",
+                     manifest_result.error_message.c_str());
+        return 1;
+      }
+      // The log owns stdout, so the summary goes to stderr
+      std::fprintf(stderr,
+                   "Copied %zu, skipped %zu, failed %zu files (%zu bytes)\n",
+                   manifest_result.files_copied, manifest_result.files_skipped,
+                   manifest_result.files_failed, manifest_result.bytes_copied);
+      return manifest_result.success ? 0 : 1;
+    }
+
+    const std::string& source = result.positional_args[0];
+    const std::string& dest = result.positional_args[1];
+
+    // "-" streams from stdin or to stdout; messages then go to stderr
+    if (cp_file::is_stdio_path(source) || cp_file::is_stdio_path(dest)) {
+      // These need a seekable source and destination or a second pass
+      for (const char* flag : {"--resume", "--update", "--delta", "--verify",
+                               "--direct", "--recursive"}) {
+        if (result.get_bool(flag)) {
+          reporter.reset();
+          std::fprintf(stderr,
+                       "Error: %s is not supported when copying from or to -\n",
+                       flag);
+          return 1;
+        }
+      }
+
+      auto size_hint = result.get<std::uint64_t>("--size-hint").value_or(0);
+      if (result.has_flag("--size-hint") && size_hint == 0) {
+        reporter.reset();
+        std::fprintf(stderr,
+                     "Error: --size-hint expects a positive byte count\n");
+        return 1;
+      }
+
+      auto stream_result =
+          cp_file::copy_stream(source, dest, options, size_hint);
+      reporter.reset();
+      if (!stream_result.success) {
+        std::fprintf(stderr, "Error: %s\n",
+                     stream_result.error_message.c_str());
+        return 1;
+      }
+      if (verbose) {
+        std::fprintf(stderr, "Copied %zu bytes\n", stream_result.bytes_copied);
+      }
+      return 0;
+    }
 
     if (verbose) {
       std::printf("Copying '%s' to '%s'...\n", source.c_str(), dest.c_str());
     }
 
-    auto copy_result = cp_file::copy_file(source, dest, force);
+    if (result.get_bool("--recursive")) {
+      auto tree_result = cp_file::copy_tree(source, dest, options);
+      reporter.reset();
+
+      for (const auto& error : tree_result.errors) {
+        std::fprintf(stderr, "Error: %s\n", error.c_str());
+      }
+      std::printf("Copied %zu, skipped %zu, failed %zu files (%zu bytes)\n",
+                  tree_result.files_copied, tree_result.files_skipped,
+                  tree_result.files_failed, tree_result.bytes_copied);
+      if (options.dedup != cp_file::DedupMode::None) {
+        std::printf("Deduplicated %zu files (%s saved)\n",
+                    tree_result.files_deduped,
+                    cp_file::format_bytes(tree_result.bytes_saved).c_str());
+      }
+      return tree_result.success ? 0 : 1;
+    }
+
+    auto copy_result = cp_file::copy_file(source, dest, options);
+    reporter.reset();
 
     if (!copy_result.success) {
       std::fprintf(stderr, "Error: %s\n", copy_result.error_message.c_str());
       return 1;
     }
 
+    if (copy_result.skipped) {
+      if (verbose) {
+        std::printf("Skipped '%s': destination is up to date\n",
+                    dest.c_str());
+      }
+      return 0;
+    }
+
     if (verbose) {
+      if (copy_result.resumed_from > 0) {
+        std::printf("Resumed at offset %zu\n", copy_result.resumed_from);
+      }
       std::printf("Copied %zu bytes\n", copy_result.bytes_copied);
+      if (copy_result.bytes_reused > 0) {
+        std::printf("Reused %zu unchanged bytes\n", copy_result.bytes_reused);
+      }
+      if (copy_result.verified) {
+        std::printf("Verified destination checksum\n");
+      }
     }
 
     return 0;
@@ -44,3 +263,5 @@ int main(int argc, char* argv[]) {
 
   return executor.run(argc, argv);
 }
+
+CLI_TOOL_MAIN("cp_file", cp_file_main)
@@ -1,6 +1,12 @@
 #include "cp_file.hpp"
+#include "manifest.hpp"
+#include "stream.hpp"
+#include "tree.hpp"
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <chrono>
@@ -156,6 +162,708 @@ TEST_F(CpFileTest, CopyFile_LargeFile) {
     EXPECT_EQ(read_file_content(dest), content);
 }
 
+TEST_F(CpFileTest, CopyFile_ProgressCounters) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    std::string content(3 * 1024 * 1024 + 17, 'P');
+    create_test_file(source, content);
+    
+    Progress progress;
+    CopyOptions options;
+    options.progress = &progress;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    auto snap = progress.snapshot();
+    EXPECT_EQ(snap.bytes_done, content.size());
+    EXPECT_EQ(snap.bytes_total, content.size());
+    EXPECT_EQ(snap.file_bytes_done, content.size());
+    EXPECT_EQ(snap.files_done, 1u);
+    EXPECT_EQ(snap.files_total, 1u);
+    EXPECT_EQ(snap.files_failed, 0u);
+}
+
+TEST_F(CpFileTest, Progress_FixedTotalsAndFailures) {
+    Progress progress;
+    progress.set_totals(2, 300);
+    progress.begin_file(100);
+    progress.add_bytes(100);
+    progress.end_file(true);
+    progress.begin_file(200);
+    progress.add_bytes(50);
+    progress.end_file(false);
+    
+    auto snap = progress.snapshot();
+    EXPECT_EQ(snap.files_total, 2u);
+    EXPECT_EQ(snap.bytes_total, 300u);
+    EXPECT_EQ(snap.bytes_done, 150u);
+    EXPECT_EQ(snap.file_bytes_done, 50u);
+    EXPECT_EQ(snap.files_done, 2u);
+    EXPECT_EQ(snap.files_failed, 1u);
+    
+    auto line = format_progress_line(snap, 2e6, 1e6);
+    EXPECT_TRUE(line.find("2.0 MB/s") != std::string::npos);
+    EXPECT_TRUE(line.find("avg 1.0 MB/s") != std::string::npos);
+    EXPECT_TRUE(line.find("files 2/2, 1 failed") != std::string::npos);
+}
+
+TEST_F(CpFileTest, Progress_EarlyFailureCounted) {
+    Progress progress;
+    CopyOptions options;
+    options.progress = &progress;
+    auto result = copy_file((test_dir_ / "missing.bin").string(),
+                            (test_dir_ / "dest.bin").string(), options);
+    
+    EXPECT_FALSE(result.success);
+    auto snap = progress.snapshot();
+    EXPECT_EQ(snap.files_total, 1u);
+    EXPECT_EQ(snap.files_done, 1u);
+    EXPECT_EQ(snap.files_failed, 1u);
+}
+
+TEST_F(CpFileTest, Progress_OverlappingCopiesDropCurrentFile) {
+    Progress progress;
+    progress.begin_file(100);
+    EXPECT_TRUE(progress.snapshot().has_current_file);
+    progress.begin_file(200);
+    progress.add_bytes(150);
+    progress.end_file(true);
+    progress.end_file(true);
+    
+    auto snap = progress.snapshot();
+    EXPECT_FALSE(snap.has_current_file);
+    auto line = format_progress_line(snap, 0, 0);
+    EXPECT_TRUE(line.find("[files 2/2]") != std::string::npos) << line;
+    EXPECT_TRUE(line.find("current") == std::string::npos);
+}
+
+TEST_F(CpFileTest, Progress_FormatHelpers) {
+    EXPECT_EQ(format_bytes(512), "512 B");
+    EXPECT_EQ(format_bytes(1536), "1.5 KiB");
+    EXPECT_EQ(format_eta(3725.0), "1:02:05");
+    EXPECT_EQ(format_eta(-1.0), "--:--");
+}
+
+TEST_F(CpFileTest, Resume_ContinuesPartialDestination) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    std::string content;
+    for (int i = 0; i < 3 * 1024 * 1024; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+    create_test_file(source, content);
+    // Partial copy: 2 MiB plus a torn tail that is not on a boundary
+    create_test_file(dest, content.substr(0, 2 * 1024 * 1024 + 1000));
+    
+    CopyOptions options;
+    options.resume = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.resumed_from, 2u * 1024u * 1024u);
+    EXPECT_EQ(result.bytes_copied, content.size() - result.resumed_from);
+    EXPECT_EQ(read_file_content(dest), content);
+    EXPECT_FALSE(std::filesystem::exists(ResumeJournal::path_for(dest.string())));
+}
+
+TEST_F(CpFileTest, Resume_VerifyPrefixDetectsCorruption) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    std::string content(4 * 1024 * 1024, 'S');
+    create_test_file(source, content);
+    std::string partial = content.substr(0, 3 * 1024 * 1024);
+    partial[3 * 1024 * 1024 - 10] = 'X';  // Damage the last sampled block
+    create_test_file(dest, partial);
+    
+    CopyOptions options;
+    options.resume = true;
+    options.verify_prefix = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_LT(result.resumed_from, 3u * 1024u * 1024u);
+    EXPECT_EQ(read_file_content(dest), content);
+}
+
+TEST_F(CpFileTest, Resume_StaleJournalRestarts) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    std::string content(2 * 1024 * 1024, 'N');
+    create_test_file(source, content);
+    create_test_file(dest, std::string(1024 * 1024, 'O'));
+    create_test_file(ResumeJournal::path_for(dest.string()),
+                     "cp_file-journal 1 1 0 0\n1048576\n");
+    
+    CopyOptions options;
+    options.resume = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.resumed_from, 0u);
+    EXPECT_EQ(read_file_content(dest), content);
+}
+
+TEST_F(CpFileTest, Update_SkipsUnchangedFile) {
+    auto source = test_dir_ / "source.txt";
+    auto dest = test_dir_ / "dest.txt";
+    
+    create_test_file(source, "Version 1");
+    
+    CopyOptions options;
+    options.update = true;
+    auto first = copy_file(source.string(), dest.string(), options);
+    EXPECT_TRUE(first.success);
+    EXPECT_FALSE(first.skipped);
+    EXPECT_EQ(std::filesystem::last_write_time(source),
+              std::filesystem::last_write_time(dest));
+    
+    auto second = copy_file(source.string(), dest.string(), options);
+    EXPECT_TRUE(second.success);
+    EXPECT_TRUE(second.skipped);
+    
+    // Same size, different mtime: copied again
+    create_test_file(source, "Version 2");
+    std::filesystem::last_write_time(
+        source, std::filesystem::last_write_time(dest) + std::chrono::seconds(5));
+    auto third = copy_file(source.string(), dest.string(), options);
+    EXPECT_TRUE(third.success);
+    EXPECT_FALSE(third.skipped);
+    EXPECT_EQ(read_file_content(dest), "Version 2");
+}
+
+TEST_F(CpFileTest, Update_CompareContentIgnoresMtime) {
+    auto source = test_dir_ / "source.txt";
+    auto dest = test_dir_ / "dest.txt";
+    
+    create_test_file(source, "Same bytes");
+    create_test_file(dest, "Same bytes");
+    std::filesystem::last_write_time(
+        dest, std::filesystem::last_write_time(source) - std::chrono::hours(1));
+    
+    CopyOptions options;
+    options.update = true;
+    options.compare_content = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_TRUE(result.skipped);
+    EXPECT_EQ(std::filesystem::last_write_time(source),
+              std::filesystem::last_write_time(dest));
+}
+
+TEST_F(CpFileTest, Update_ChecksumModeComparesBytes) {
+    auto source = test_dir_ / "source.txt";
+    auto dest = test_dir_ / "dest.txt";
+    create_test_file(source, "Same size A");
+    create_test_file(dest, "Same size B");
+    
+    CopyOptions options;
+    options.update = true;
+    options.compare_content = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_FALSE(result.skipped);
+    EXPECT_EQ(read_file_content(dest), "Same size A");
+}
+
+TEST_F(CpFileTest, DurabilityBatch_CommitHonoursNoReplace) {
+    create_test_file(test_dir_ / ".a.tmp", "new A");
+    create_test_file(test_dir_ / ".b.tmp", "new B");
+    create_test_file(test_dir_ / "a.txt", "concurrent A");
+    create_test_file(test_dir_ / "b.txt", "old B");
+    
+    DurabilityBatch batch;
+    batch.add_rename((test_dir_ / ".a.tmp").string(), (test_dir_ / "a.txt").string(), false);
+    batch.add_rename((test_dir_ / ".b.tmp").string(), (test_dir_ / "b.txt").string(), true);
+    std::vector<std::string> errors;
+    EXPECT_EQ(batch.commit(errors), 1u);
+    
+    ASSERT_EQ(errors.size(), 1u);
+    EXPECT_EQ(errors[0], "Destination already exists: " + (test_dir_ / "a.txt").string());
+    EXPECT_EQ(read_file_content(test_dir_ / "a.txt"), "concurrent A");
+    EXPECT_EQ(read_file_content(test_dir_ / "b.txt"), "new B");
+    EXPECT_FALSE(std::filesystem::exists(test_dir_ / ".a.tmp"));
+    EXPECT_EQ(batch.pending(), 0u);
+}
+
+TEST_F(CpFileTest, CopyTree_UpdateSummary) {
+    auto src_dir = test_dir_ / "src";
+    auto dst_dir = test_dir_ / "dst";
+    
+    create_test_file(src_dir / "a.txt", "A");
+    create_test_file(src_dir / "sub" / "b.txt", "BB");
+    create_test_file(src_dir / "sub" / "deeper" / "c.txt", "CCC");
+    
+    CopyOptions options;
+    options.update = true;
+    auto first = copy_tree(src_dir.string(), dst_dir.string(), options);
+    EXPECT_TRUE(first.success);
+    EXPECT_EQ(first.files_copied, 3u);
+    EXPECT_EQ(first.files_skipped, 0u);
+    EXPECT_EQ(first.bytes_copied, 6u);
+    EXPECT_EQ(read_file_content(dst_dir / "sub" / "deeper" / "c.txt"), "CCC");
+    
+    create_test_file(src_dir / "sub" / "b.txt", "changed");
+    auto second = copy_tree(src_dir.string(), dst_dir.string(), options);
+    EXPECT_TRUE(second.success);
+    EXPECT_EQ(second.files_copied, 1u);
+    EXPECT_EQ(second.files_skipped, 2u);
+    EXPECT_EQ(second.files_failed, 0u);
+    EXPECT_EQ(read_file_content(dst_dir / "sub" / "b.txt"), "changed");
+}
+
+TEST_F(CpFileTest, Delta_RewritesOnlyChangedBlocks) {
+    auto source = test_dir_ / "image.bin";
+    auto dest = test_dir_ / "backup.bin";
+    
+    std::string original(4 * 1024 * 1024, 'D');
+    create_test_file(dest, original);
+    
+    std::string modified = original;
+    modified[100] = 'x';                     // First block
+    modified[2 * 1024 * 1024 + 5] = 'y';     // One block in the middle
+    modified += "appended tail";             // Grows past the old size
+    create_test_file(source, modified);
+    
+    CopyOptions options;
+    options.delta = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(read_file_content(dest), modified);
+    EXPECT_EQ(result.bytes_copied, 2 * kDeltaBlockSize + 13);
+    EXPECT_EQ(result.bytes_copied + result.bytes_reused, modified.size());
+}
+
+TEST_F(CpFileTest, Delta_TruncatesLongerDestination) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    create_test_file(source, std::string(100000, 'S'));
+    create_test_file(dest, std::string(300000, 'S'));
+    
+    CopyOptions options;
+    options.delta = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.bytes_copied, 0u);
+    EXPECT_EQ(std::filesystem::file_size(dest), 100000u);
+}
+
+TEST_F(CpFileTest, Checksum_Crc32cKnownValues) {
+    // Standard CRC-32C check value
+    EXPECT_EQ(crc32c("123456789", 9), 0xE3069283u);
+    const auto* digits = reinterpret_cast<const unsigned char*>("123456789");
+    EXPECT_EQ(~detail::crc32c_sw(digits, 9, ~0u), 0xE3069283u);
+    // Hashing in pieces matches hashing in one go
+    std::string data(100003, 'z');
+    auto whole = crc32c(data.data(), data.size());
+    auto part = crc32c(data.data(), 777);
+    part = crc32c(data.data() + 777, data.size() - 777, part);
+    EXPECT_EQ(whole, part);
+}
+
+TEST_F(CpFileTest, Verify_CopyMatches) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    std::string content;
+    for (int i = 0; i < 5 * 1024 * 1024 + 3; ++i) {
+        content.push_back(static_cast<char>(i * 7));
+    }
+    create_test_file(source, content);
+    
+    CopyOptions options;
+    options.verify = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_TRUE(result.verified);
+    EXPECT_EQ(result.bytes_copied, content.size());
+    EXPECT_EQ(read_file_content(dest), content);
+}
+
+TEST_F(CpFileTest, Verify_WithDelta) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    create_test_file(source, std::string(300000, 'a') + "b");
+    create_test_file(dest, std::string(300001, 'a'));
+    
+    CopyOptions options;
+    options.delta = true;
+    options.verify = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_TRUE(result.verified);
+}
+
+TEST_F(CpFileTest, Direct_CopiesUnalignedSize) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    // Several cache-drop windows plus a tail that is not block aligned
+    std::string content;
+    for (int i = 0; i < 20 * 1024 * 1024 + 4097; ++i) {
+        content.push_back(static_cast<char>(i % 251));
+    }
+    create_test_file(source, content);
+    
+    CopyOptions options;
+    options.direct = true;
+    options.verify = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success) << result.error_message;
+    EXPECT_TRUE(result.verified);
+    EXPECT_EQ(result.bytes_copied, content.size());
+    EXPECT_EQ(read_file_content(dest), content);
+}
+
+TEST_F(CpFileTest, Direct_WithResume) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    
+    std::string content(3 * 1024 * 1024 + 100, 'R');
+    create_test_file(source, content);
+    create_test_file(dest, content.substr(0, 1024 * 1024));
+    
+    CopyOptions options;
+    options.direct = true;
+    options.resume = true;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success) << result.error_message;
+    EXPECT_EQ(result.resumed_from, 1024u * 1024u);
+    EXPECT_EQ(read_file_content(dest), content);
+}
+
+TEST_F(CpFileTest, Durability_AtomicReplacesDestination) {
+    auto source = test_dir_ / "source.txt";
+    auto dest = test_dir_ / "dest.txt";
+    
+    create_test_file(source, "New content");
+    create_test_file(dest, "Old content that is longer");
+    
+    CopyOptions options;
+    options.overwrite = true;
+    options.durability = Durability::Atomic;
+    auto result = copy_file(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success) << result.error_message;
+    EXPECT_EQ(read_file_content(dest), "New content");
+    // Only source and dest remain: the temp file was renamed away
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(test_dir_),
+                            std::filesystem::directory_iterator()), 2);
+}
+
+TEST_F(CpFileTest, Durability_FsyncTreeCommitsBatch) {
+    auto src_dir = test_dir_ / "src";
+    auto dst_dir = test_dir_ / "dst";
+    
+    create_test_file(src_dir / "a.txt", "A");
+    create_test_file(src_dir / "sub" / "b.txt", "BB");
+    
+    CopyOptions options;
+    options.durability = Durability::Fsync;
+    auto result = copy_tree(src_dir.string(), dst_dir.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.files_copied, 2u);
+    EXPECT_EQ(read_file_content(dst_dir / "a.txt"), "A");
+    EXPECT_EQ(read_file_content(dst_dir / "sub" / "b.txt"), "BB");
+    for (const auto& entry :
+         std::filesystem::recursive_directory_iterator(dst_dir)) {
+        EXPECT_EQ(entry.path().filename().string().find(".cp_file."),
+                  std::string::npos);
+    }
+}
+
+TEST_F(CpFileTest, Fd_FifoSourceIsRejectedWithoutBlocking) {
+    auto source = test_dir_ / "pipe";
+    auto dest = test_dir_ / "dest.txt";
+    ASSERT_EQ(::mkfifo(source.c_str(), 0600), 0);
+    
+    auto result = copy_file(source.string(), dest.string());
+    
+    EXPECT_FALSE(result.success);
+    EXPECT_TRUE(result.error_message.find("not a regular file") != std::string::npos);
+    EXPECT_FALSE(std::filesystem::exists(dest));
+}
+
+TEST_F(CpFileTest, DirectoryCache_CreatesAndReusesDirectories) {
+    auto nested = test_dir_ / "a" / "b" / "c";
+    
+    DirectoryCache dirs;
+    auto first = dirs.open(nested.string());
+    ASSERT_TRUE(first);
+    EXPECT_TRUE(std::filesystem::is_directory(nested));
+    EXPECT_EQ(dirs.open(nested.string()), first);
+    
+    create_test_file(test_dir_ / "source.txt", "via openat");
+    CopyOptions options;
+    options.dirs = &dirs;
+    auto result = copy_file((test_dir_ / "source.txt").string(),
+                            (nested / "dest.txt").string(), options);
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.bytes_copied, 10u);
+    EXPECT_EQ(read_file_content(nested / "dest.txt"), "via openat");
+}
+
+TEST_F(CpFileTest, Manifest_CopiesPairsAndLogsEachEntry) {
+    std::string manifest_text = "# comment\n";
+    for (int i = 0; i < 20; ++i) {
+        auto name = "f" + std::to_string(i) + ".txt";
+        create_test_file(test_dir_ / "in" / name, std::string(i + 1, 'm'));
+        manifest_text += (test_dir_ / "in" / name).string() + "\t" +
+                         (test_dir_ / "out" / std::to_string(i % 3) / name).string() + "\n";
+    }
+    manifest_text += (test_dir_ / "missing.txt").string() + "\t" +
+                     (test_dir_ / "out" / "missing.txt").string() + "\n";
+    manifest_text += "no tab here\n\n";
+    auto manifest = test_dir_ / "pairs.tsv";
+    create_test_file(manifest, manifest_text);
+    auto log_path = test_dir_ / "log.tsv";
+    
+    std::FILE* log = std::fopen(log_path.c_str(), "w");
+    ASSERT_NE(log, nullptr);
+    auto result = copy_manifest(manifest.string(), CopyOptions(), 4, log);
+    std::fclose(log);
+    
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.entries, 22u);
+    EXPECT_EQ(result.files_copied, 20u);
+    EXPECT_EQ(result.files_failed, 2u);
+    EXPECT_EQ(result.bytes_copied, 210u);
+    EXPECT_EQ(read_file_content(test_dir_ / "out" / "1" / "f7.txt"), "mmmmmmmm");
+    
+    std::ifstream in(log_path);
+    std::string line;
+    std::size_t ok = 0;
+    std::size_t failed = 0;
+    bool malformed = false;
+    while (std::getline(in, line)) {
+        if (line.find("\tok\t") != std::string::npos) ++ok;
+        if (line.find("\tfailed\t") != std::string::npos) ++failed;
+        malformed |= line == "23\tfailed\t0\t\t\tMalformed manifest line";
+    }
+    EXPECT_EQ(ok, 20u);
+    EXPECT_EQ(failed, 2u);
+    EXPECT_TRUE(malformed);
+}
+
+TEST_F(CpFileTest, Manifest_ParseLine) {
+    std::string source;
+    std::string dest;
+    EXPECT_TRUE(parse_manifest_line("a b\tc d\r", source, dest));
+    EXPECT_EQ(source, "a b");
+    EXPECT_EQ(dest, "c d");
+    EXPECT_FALSE(parse_manifest_line("only-source", source, dest));
+    EXPECT_FALSE(parse_manifest_line("\tdest", source, dest));
+    EXPECT_FALSE(parse_manifest_line("a\tb\tc", source, dest));
+}
+
+TEST_F(CpFileTest, Dedup_FindDuplicatesConfirmsContent) {
+    create_test_file(test_dir_ / "a", "same bytes");
+    create_test_file(test_dir_ / "b", "other byte");  // Same size, differs
+    create_test_file(test_dir_ / "c", "same bytes");
+    create_test_file(test_dir_ / "d", "");
+    create_test_file(test_dir_ / "e", "");
+    
+    std::vector<std::string> paths;
+    for (const char* name : {"a", "b", "c", "d", "e"}) {
+        paths.push_back((test_dir_ / name).string());
+    }
+    auto canonical = find_duplicates(paths, {10, 10, 10, 0, 0});
+    
+    EXPECT_EQ(canonical, (std::vector<std::size_t>{0, 1, 0, 3, 4}));
+}
+
+TEST_F(CpFileTest, Dedup_TreeHardlinksDuplicates) {
+    auto src_dir = test_dir_ / "src";
+    auto dst_dir = test_dir_ / "dst";
+    
+    std::string library(100000, 'L');
+    create_test_file(src_dir / "one" / "lib.so", library);
+    create_test_file(src_dir / "two" / "lib.so", library);
+    create_test_file(src_dir / "unique.txt", "unique");
+    
+    CopyOptions options;
+    options.dedup = DedupMode::Hardlink;
+    auto result = copy_tree(src_dir.string(), dst_dir.string(), options);
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.files_copied, 3u);
+    EXPECT_EQ(result.files_deduped, 1u);
+    EXPECT_EQ(result.bytes_saved, library.size());
+    EXPECT_EQ(result.bytes_copied, library.size() + 6);
+    EXPECT_EQ(read_file_content(dst_dir / "two" / "lib.so"), library);
+    EXPECT_TRUE(std::filesystem::equivalent(dst_dir / "one" / "lib.so",
+                                            dst_dir / "two" / "lib.so"));
+}
+
+// Run the built cp_file with arguments (already shell-quoted where needed)
+int run_cp_file(const std::string& args) {
+    std::string command = std::string("'") + CP_FILE_BINARY + "' " + args + " >/dev/null 2>&1";
+    int status = std::system(command.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST_F(CpFileTest, Dedup_FlagDoesNotConsumePaths) {
+    auto src_dir = test_dir_ / "src";
+    std::string library(4096, 'L');
+    create_test_file(src_dir / "one" / "lib.so", library);
+    create_test_file(src_dir / "two" / "lib.so", library);
+    
+    auto dst_dir = test_dir_ / "dst";
+    EXPECT_EQ(run_cp_file("-r --dedup '" + src_dir.string() + "' '" + dst_dir.string() + "'"), 0);
+    EXPECT_EQ(read_file_content(dst_dir / "two" / "lib.so"), library);
+    
+    auto linked_dir = test_dir_ / "linked";
+    EXPECT_EQ(run_cp_file("-r --dedup-mode hardlink '" + src_dir.string() + "' '" +
+                          linked_dir.string() + "'"), 0);
+    EXPECT_TRUE(std::filesystem::equivalent(linked_dir / "one" / "lib.so",
+                                            linked_dir / "two" / "lib.so"));
+    
+    EXPECT_NE(run_cp_file("-r --dedup-mode symlink '" + src_dir.string() + "' '" +
+                          (test_dir_ / "bad").string() + "'"), 0);
+}
+
+TEST_F(CpFileTest, Throttle_RateLimiterSharedAcrossThreads) {
+    RateLimiter unlimited(0.0, 1);
+    EXPECT_FALSE(unlimited.enabled());
+    
+    // 1000 units/s: two threads taking 100 units each need ~200 ms together
+    RateLimiter limiter(1000.0, 1);
+    auto start = std::chrono::steady_clock::now();
+    std::thread other([&] { limiter.acquire(100); });
+    limiter.acquire(100);
+    other.join();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    EXPECT_GE(elapsed, std::chrono::milliseconds(150));
+    EXPECT_LT(elapsed, std::chrono::seconds(2));
+}
+
+TEST_F(CpFileTest, Throttle_BandwidthLimitPacesCopy) {
+    auto source = test_dir_ / "source.bin";
+    auto dest = test_dir_ / "dest.bin";
+    std::string content(4 * 1024 * 1024, 'T');
+    create_test_file(source, content);
+    
+    // 20 MB/s with a 1 MiB burst: the other 3 MiB take at least ~150 ms
+    Throttle throttle(20.0 * 1000 * 1000, 0.0);
+    CopyOptions options;
+    options.throttle = &throttle;
+    auto start = std::chrono::steady_clock::now();
+    auto result = copy_file(source.string(), dest.string(), options);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(read_file_content(dest), content);
+    EXPECT_GE(elapsed, std::chrono::milliseconds(120));
+}
+
+TEST_F(CpFileTest, Stream_SplicesFromStdinPipe) {
+    auto dest = test_dir_ / "dest.bin";
+    std::string content;
+    for (int i = 0; i < 3 * 1024 * 1024 + 11; ++i) {
+        content.push_back(static_cast<char>(i % 253));
+    }
+    
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    int saved_stdin = ::dup(STDIN_FILENO);
+    ::dup2(fds[0], STDIN_FILENO);
+    ::close(fds[0]);
+    std::thread producer([&] {
+        ASSERT_TRUE(detail::write_all(fds[1], content.data(), content.size()));
+        ::close(fds[1]);
+    });
+    
+    auto result = copy_stream("-", dest.string(), CopyOptions(), 8 * 1024 * 1024);
+    producer.join();
+    ::dup2(saved_stdin, STDIN_FILENO);
+    ::close(saved_stdin);
+    
+    EXPECT_TRUE(result.success) << result.error_message;
+    EXPECT_EQ(result.bytes_copied, content.size());
+    EXPECT_EQ(read_file_content(dest), content);
+}
+
+TEST_F(CpFileTest, Stream_RefusesExistingDestination) {
+    auto source = test_dir_ / "source.txt";
+    auto dest = test_dir_ / "dest.txt";
+    create_test_file(source, "new");
+    create_test_file(dest, "old");
+    
+    auto result = copy_stream(source.string(), dest.string(), CopyOptions());
+    
+    EXPECT_FALSE(result.success);
+    EXPECT_TRUE(result.error_message.find("already exists") != std::string::npos);
+    EXPECT_EQ(read_file_content(dest), "old");
+}
+
+TEST_F(CpFileTest, Stream_AtomicReplacesAndKeepsMode) {
+    auto source = test_dir_ / "source.txt";
+    auto dest = test_dir_ / "dest.txt";
+    create_test_file(source, "new");
+    create_test_file(dest, "old contents");
+    ASSERT_EQ(::chmod(dest.c_str(), 0640), 0);
+    
+    CopyOptions options;
+    options.overwrite = true;
+    options.durability = Durability::Fsync;
+    auto result = copy_stream(source.string(), dest.string(), options);
+    
+    EXPECT_TRUE(result.success) << result.error_message;
+    EXPECT_EQ(read_file_content(dest), "new");
+    struct stat st;
+    ASSERT_EQ(::stat(dest.c_str(), &st), 0);
+    EXPECT_EQ(st.st_mode & 07777, 0640u);
+    std::size_t entries = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(test_dir_)) {
+        (void)entry;
+        ++entries;
+    }
+    EXPECT_EQ(entries, 2u);  // No temp file left behind
+}
+
+TEST_F(CpFileTest, Stream_RejectsUnsupportedOptions) {
+    auto source = test_dir_ / "source.txt";
+    create_test_file(source, "data");
+    std::string args = "'" + source.string() + "' - ";
+    EXPECT_EQ(run_cp_file(args + "--verify"), 1);
+    EXPECT_EQ(run_cp_file(args + "--direct"), 1);
+    EXPECT_EQ(run_cp_file(args), 0);
+}
+
+TEST_F(CpFileTest, Preallocate_ReservesWithoutChangingSize) {
+    auto path = test_dir_ / "reserved.bin";
+    create_test_file(path, "");
+    
+    int fd = ::open(path.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    // Below the threshold nothing is reserved
+    EXPECT_TRUE(detail::preallocate(fd, 0, 4096));
+    EXPECT_TRUE(detail::preallocate(fd, 0, 8 * 1024 * 1024));
+    struct stat st;
+    ASSERT_EQ(::fstat(fd, &st), 0);
+    ::close(fd);
+    
+    // Size is untouched (resume and update depend on it); blocks are
+    // reserved unless the filesystem lacks fallocate
+    EXPECT_EQ(st.st_size, 0);
+    EXPECT_TRUE(st.st_blocks == 0 || st.st_blocks * 512 >= 8 * 1024 * 1024);
+}
+
 } // namespace
 } // namespace cp_file
 
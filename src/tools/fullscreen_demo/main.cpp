@@ -5,8 +5,9 @@
 
 #include "cli.hpp"
 #include "fullscreen_terminal.hpp"
+#include "multicall.hpp"
 
-int main(int argc, char *argv[]) {
+static int fullscreen_demo_main(int argc, char *argv[]) {
   cli::CliExecutor executor("fullscreen_demo",
                             "Demonstrates fullscreen terminal mode");
 
@@ -273,3 +274,5 @@ int main(int argc, char *argv[]) {
 
   return executor.run(argc, argv);
 }
+
+CLI_TOOL_MAIN("fullscreen_demo", fullscreen_demo_main)
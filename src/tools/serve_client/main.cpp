@@ -0,0 +1,20 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "multicall.hpp"
+#include "serve.hpp"
+
+// Forwards its arguments to a tool started with `--serve=<socket>` and
+// replays the command's output and exit code, so each invocation costs a
+// socket round trip instead of starting the tool
+static int serve_client_main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: serve_client <socket> [args...]\n");
+        return 2;
+    }
+    std::vector<std::string> args(argv + 2, argv + argc);
+    return cli::forward_command(argv[1], args);
+}
+
+CLI_TOOL_MAIN("serve_client", serve_client_main)
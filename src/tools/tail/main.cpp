@@ -1,11 +1,12 @@
+#include <cstdint>
 #include <cstdio>
-#include <cstdlib>
 
 #include "cli.hpp"
+#include "multicall.hpp"
 #include "stdin_reader.hpp"
 #include "tail.hpp"
 
-int main(int argc, char* argv[]) {
+static int tail_main(int argc, char* argv[]) {
     cli::CliExecutor executor("tail", "Display the last lines of input");
 
     // Default command - show last lines
@@ -13,17 +14,10 @@ int main(int argc, char* argv[]) {
         "show", "Show last N lines of input",
         [](const cli::ParseResult& result) {
             // Get number of lines (default 10)
-            std::size_t num_lines = 10;
-            auto n_args = result.get_args("--lines");
-            if (!n_args.empty()) {
-                char* end;
-                long val = std::strtol(n_args[0].c_str(), &end, 10);
-                if (*end != '\0' || val <= 0) {
-                    std::fprintf(stderr, "Error: Invalid line count: %s\n",
-                                 n_args[0].c_str());
-                    return 1;
-                }
-                num_lines = static_cast<std::size_t>(val);
+            auto num_lines = result.get<std::uint64_t>("--lines").value_or(10);
+            if (num_lines == 0) {
+                std::fprintf(stderr, "Error: Invalid line count: 0\n");
+                return 1;
             }
 
             // Get input source
@@ -73,7 +67,7 @@ int main(int argc, char* argv[]) {
         });
 
     // Add command-specific flags
-    executor.add_command_flag("show", "-n,--lines", cli::FlagType::MultiArg,
+    executor.add_command_flag("show", "-n,--lines", cli::FlagType::UInt64,
                               "Number of lines to display (default: 10)");
     executor.add_command_flag("show", "-f,--file", cli::FlagType::MultiArg,
                               "Input file (use - for stdin)");
@@ -85,3 +79,4 @@ int main(int argc, char* argv[]) {
     return executor.run(argc, argv);
 }
 
+CLI_TOOL_MAIN("tail", tail_main)